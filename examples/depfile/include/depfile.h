@@ -0,0 +1 @@
+#define DEPFILE_EXIT_CODE 0
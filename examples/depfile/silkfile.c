@@ -0,0 +1,43 @@
+#define SILK_IMPLEMENTATION
+#include <silk.h>
+#include <silk/assert.h>
+
+/* The dependencies of the objects are read from their dependency file when the database doesn't know them,
+   an empty dependency file must not stop the build.
+   The compiler runs in the output directory, a header found with a relative include directory must not
+   recompile the object each time. */
+int main(void)
+{
+    const char* output_dir = NULL;
+    const char* object = NULL;
+    double mtime = 0;
+    double new_mtime = 0;
+
+    silk_init();
+
+    silk_project("depfile");
+    silk_set(silk_BINARY_TYPE, silk_EXE);
+    silk_set(silk_OUTPUT_DIR, ".build/depfile/");
+
+    silk_add(silk_CXFLAGS, "-I../../include"); /* Relative to the output directory */
+    silk_add(silk_FILES, "src/main.c");
+
+    silk_assert_file_exists(silk_bake());
+
+    output_dir = silk_path_get_absolute_dir(".build/depfile/");
+    object = silk_gcc_object_path(output_dir, silk_path_get_absolute_file("src/main.c"));
+
+    silk_assert_true(silk_file_mtime(object, &mtime));
+    silk_assert_file_exists(silk_bake());
+    silk_assert_true(silk_file_mtime(object, &new_mtime) && new_mtime == mtime);
+
+    remove(silk_db_path(output_dir, "depfile"));
+    silk_assert_true(silk_write_file(silk_gcc_depfile_path(object), "", 0));
+    utime(object, NULL);
+
+    silk_assert_file_exists(silk_bake());
+
+    silk_destroy();
+
+    return 0;
+}
@@ -0,0 +1,6 @@
+#include "depfile.h"
+
+int main(void)
+{
+    return DEPFILE_EXIT_CODE;
+}
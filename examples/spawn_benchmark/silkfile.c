@@ -0,0 +1,60 @@
+#define SILK_IMPLEMENTATION
+#include <silk.h>
+#include <stdlib.h>
+
+/* Average and slowest time to start a trivial command and wait for it, in milliseconds. */
+static void
+run_commands(int runs, double* average, double* slowest)
+{
+    double start = 0;
+    double elapsed = 0;
+    double total = 0;
+    int i = 0;
+
+    *slowest = 0;
+    for (i = 0; i < runs; ++i)
+    {
+        start = silk_time_ms();
+        silk_process_end(silk_process_to_string("true", NULL, silk_true));
+        elapsed = silk_time_ms() - start;
+
+        total += elapsed;
+        *slowest = elapsed > *slowest ? elapsed : *slowest;
+    }
+    *average = total / runs;
+}
+
+/* Time to start a trivial command and wait for it, while silk holds a large heap like a big build does.
+   Commands are started with fork, then with posix_spawn.
+   Usage: silkfile [runs] [heap MiB] */
+int main(int argc, char** argv)
+{
+    int runs = argc > 1 ? atoi(argv[1]) : 1000;
+    size_t heap_size = (size_t)(argc > 2 ? atoi(argv[2]) : 512) * 1024 * 1024;
+    char* heap = NULL;
+    double fork_average = 0;
+    double fork_slowest = 0;
+    double spawn_average = 0;
+    double spawn_slowest = 0;
+
+    silk_init();
+
+    /* Touch every page, a fork copies the page tables of the resident memory */
+    heap = (char*)malloc(heap_size);
+    memset(heap, 1, heap_size);
+
+    silk_process_fork_enabled = silk_true;
+    run_commands(runs, &fork_average, &fork_slowest);
+    silk_process_fork_enabled = silk_false;
+    run_commands(runs, &spawn_average, &spawn_slowest);
+
+    printf("%d runs with a %d MiB heap, ms per command:\n", runs, (int)(heap_size / (1024 * 1024)));
+    printf("              average  slowest\n");
+    printf("  fork        %7.3f  %7.3f\n", fork_average, fork_slowest);
+    printf("  posix_spawn %7.3f  %7.3f\n", spawn_average, spawn_slowest);
+
+    free(heap);
+    silk_destroy();
+
+    return 0;
+}
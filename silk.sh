@@ -44,7 +44,7 @@ if [ -v silk_gcc ] && [ -v silk_pedantic ]; then silk_cxflags="-std=c89 -pedanti
 
 # Check if there is a value in silk_gcc.
 if [ -v silk_gcc ]; then
-   $silk_compiler $silk_cxflags -g -I $silk_include_dir -o "$silk_output" -O0 $silk_filename || { echo "'$silk_compiler' exited with $?"; exit 1; }
+   $silk_compiler $silk_cxflags -g -pthread -I $silk_include_dir -o "$silk_output" -O0 $silk_filename || { echo "'$silk_compiler' exited with $?"; exit 1; }
 fi
 
 # Check if there is a value in silk_run.
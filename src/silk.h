@@ -3,6 +3,13 @@
 
 #define SILK_IMPLEMENTATION
 
+/* The implementation uses POSIX.1-2008 and BSD functions (nanosecond modification times, kill, syscall, etc.),
+   strict C modes (-std=c89) hide them otherwise. Only effective when silk.h is included before the system headers,
+   a silkfile including them first must define _DEFAULT_SOURCE itself (-D_DEFAULT_SOURCE). */
+#if defined(SILK_IMPLEMENTATION) && !defined(_WIN32) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
 #include <ctype.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -25,6 +32,17 @@
 	#include <sys/sendfile.h> /* sendfile */
 	#include <sys/wait.h>     /* waitpid */
 	#include <dirent.h>       /* opendir */
+	#include <pthread.h>      /* pthread_create */
+	#include <utime.h>        /* utime */
+	#include <poll.h>         /* poll */
+	#include <time.h>         /* clock_gettime */
+	#include <sys/resource.h> /* getrusage */
+	#include <sys/mman.h>     /* mmap */
+	#include <signal.h>       /* kill */
+	#include <spawn.h>        /* posix_spawnp */
+	#if defined(__linux__)
+	#include <sys/syscall.h>  /* SYS_pidfd_open */
+	#endif
 
 	#define SILK_THREAD __thread
 #endif
@@ -165,6 +183,14 @@ SILK_API const char* silk_bake_project(const char* project_name);
 /* Same as silk_bake. Take an explicit toolchain instead of using the default one. */
 SILK_API const char* silk_bake_project_with(silk_toolchain toolchain, const char* project_name);
 
+/* Bake all the projects. Projects listed in silk_LINK_PROJECTS are baked before the projects linking them,
+   projects which don't depend on each other are baked at the same time.
+   Returns false if a project could not be baked or if projects link each other in a cycle. */
+SILK_API silk_bool silk_bake_all(void);
+
+/* Same as silk_bake_all. Take an explicit toolchain instead of using the default one. */
+SILK_API silk_bool silk_bake_all_with(silk_toolchain toolchain);
+
 /* Run executable path. Path is double quoted before being run, in case path contains some space.
    Returns exit code. Returns -1 if command could not be executed.
 */
@@ -173,6 +199,50 @@ SILK_API int silk_run(const char* cmd);
 /* Turn on/off debug messages */
 SILK_API void silk_debug(silk_bool value);
 
+/* Turn on/off buffered output of silk_process, silk_process_in_directory and silk_process_argv. When on, the output of each command
+   is captured and printed at once when the command exits, so the outputs of commands running at the same time are not mixed.
+   Off by default, the output is then printed as it comes. The commands of the toolchains (compilations, links, etc.) are always buffered. */
+SILK_API void silk_buffered_output(silk_bool value);
+
+/* Set the maximum number of commands (compilation, link, etc.) running at the same time.
+   0 means the number of online CPUs, which is the default.
+   When run by make with a jobserver (MAKEFLAGS contains --jobserver-auth), commands also take a token from make,
+   otherwise silk provides a jobserver to the commands it runs, so nested builds share the same limit.
+   The jobserver is given to the commands in their MAKEFLAGS, except to the ones run with their own environment (silk_process_argv).
+   POSIX only: on Windows, the jobserver of make (a named semaphore) is not supported and the limit is not shared. */
+SILK_API void silk_jobs(silk_size count);
+
+/* Set the directory of the compilation cache, objects found in the cache are copied instead of being compiled again.
+   The cache is keyed by the preprocessed source, the compiler and the flags so it can be shared between projects.
+   Paths under the current directory are made relative in the key, so the same sources in another checkout share the objects.
+   Objects compiled with debug information still contain the paths of the checkout that compiled them (see -fdebug-prefix-map).
+   NULL disables the cache, which is the default. Only used by the gcc toolchain. */
+SILK_API void silk_cache_directory(const char* directory);
+
+/* Set the maximum size in bytes of the compilation cache, the least recently used objects are removed first.
+   Default is 1 GiB. */
+SILK_API void silk_cache_max_size(silk_size size);
+
+/* Write a trace of the commands run by silk_bake and silk_bake_all to the file, in the Chrome trace event format
+   (chrome://tracing, ui.perfetto.dev). The file is written again after each bake with everything run since the trace started.
+   Traces written by the compiler with -ftime-trace are included in the compilations. NULL stops the trace, which is the default. */
+SILK_API void silk_trace_file(const char* path);
+
+/* Turn on/off the summary printed at the end of silk_bake and silk_bake_all when commands were run:
+   wall time, time spent in the commands, CPU time, the slowest compilations and the links. On by default. */
+SILK_API void silk_build_summary(silk_bool value);
+
+/* Write a compilation database (compile_commands.json, used by clangd, clang-tidy, etc.) with one entry per source
+   of the projects baked by silk_bake and silk_bake_all, with the same flags, defines and include directories.
+   Each project keeps its entries in its output directory and only rewrites them when they changed,
+   so the database is regenerated quickly. NULL disables it, which is the default. Only used by the gcc toolchain. */
+SILK_API void silk_compile_commands(const char* path);
+
+/* Turn on/off the dry run: silk_bake and silk_bake_all print the commands they would run, why they would run them
+   and how long they took the previous times, without running anything. Artefacts are not created, so the paths
+   returned by the bakes may not exist. The compilation database is still written. Off by default. Only used by the gcc toolchain. */
+SILK_API void silk_dry_run(silk_bool value);
+
 SILK_API silk_toolchain silk_toolchain_default(void);
 
 /* Run command and returns exit code. */
@@ -194,9 +264,50 @@ SILK_API const char* silk_process_stdout_string(silk_process_handle* handle);
 /* Get c string content of stderr of the child process after silk_process_to_string has been called. */
 SILK_API const char* silk_process_stderr_string(silk_process_handle* handle);
 
-/* Returns exit code of the process and clean up resources. */
+/* Returns exit code of the process and clean up resources. Waits for the process if it was started by silk_process_start. */
 SILK_API int silk_process_end(silk_process_handle* handle);
 
+/* Start command without waiting for the process to end, several processes can run at the same time.
+   stdout (and stderr if 'also_get_stderr' is true) is read into buffers as silk_process_poll or silk_process_wait_any
+   are called, the strings are complete once the process is over. A command that could not be started is over at once.
+   silk_process_end(handle) needs to be called to get the exit code and cleanup various resources. */
+SILK_API silk_process_handle* silk_process_start(const char* cmd, const char* starting_directory, silk_bool also_get_stderr);
+
+/* Read the output available without blocking, returns true when the process is over. */
+SILK_API silk_bool silk_process_poll(silk_process_handle* handle);
+
+/* Wait until one of the processes is over and returns its index in 'handles', NULL handles are skipped.
+   Returns -1 if there is no process in 'handles'. A process is returned until it's removed from 'handles',
+   set it to NULL after calling silk_process_end. */
+SILK_API int silk_process_wait_any(silk_process_handle** handles, silk_size count);
+
+/* Same as silk_process_in_directory, but the arguments are given as is: they are neither parsed nor quoted.
+   'argv' ends with NULL and argv[0] is looked for in PATH. 'env' is the environment of the process,
+   "NAME=value" strings ending with NULL, or NULL to inherit the environment of silk. 'directory' can be NULL. */
+SILK_API int silk_process_argv(const char* const* argv, const char* directory, const char* const* env);
+
+/* Same as silk_process_to_string with the arguments given as is, see silk_process_argv. */
+SILK_API silk_process_handle* silk_process_argv_to_string(const char* const* argv, const char* starting_directory, const char* const* env, silk_bool also_get_stderr);
+
+/* Same as silk_process_start with the arguments given as is, see silk_process_argv.
+   'argv' and 'env' must stay valid until silk_process_end is called. */
+SILK_API silk_process_handle* silk_process_argv_start(const char* const* argv, const char* starting_directory, const char* const* env, silk_bool also_get_stderr);
+
+/* Set the wall-clock time limit, in seconds, of the commands started afterwards (compilation, link, silk_process, etc.).
+   A command running longer is terminated, then killed if it's still running a second later, and fails.
+   0 means no limit, which is the default. */
+SILK_API void silk_process_timeout(double seconds);
+
+/* Set the limits of the address space (RLIMIT_AS), in bytes, and of the CPU time (RLIMIT_CPU), in seconds,
+   of the commands started afterwards. 0 means no limit, which is the default. POSIX only. */
+SILK_API void silk_process_memory_limit(silk_size bytes);
+SILK_API void silk_process_cpu_limit(silk_size seconds);
+
+/* Turn on/off running each command started afterwards in its own process group. A command timing out is terminated
+   with the processes it started, and a signal interrupting silk (SIGINT, SIGTERM, SIGHUP) is forwarded to the groups
+   of the running commands. A command in its own group can't read from the terminal. Off by default. POSIX only. */
+SILK_API void silk_process_group(silk_bool value);
+
 /* Commonly used properties (basically to make it discoverable with auto completion and avoid misspelling) */
 
 /* keys */
@@ -210,10 +321,24 @@ extern const char* silk_LIBRARIES;           /* Libraries to link with. */
 extern const char* silk_LFLAGS;              /* Extra flags to give to the linker. */
 extern const char* silk_OUTPUT_DIR;          /* Ouput directory for the generated files. */
 extern const char* silk_TARGET_NAME;         /* Name (basename) of the main generated file (.exe, .a, .lib, .dll, etc.). */
+extern const char* silk_REBUILD_MODE;        /* How to decide that a file needs to be compiled again, silk_TIMESTAMP by default. */
+extern const char* silk_UNITY_BUILD;         /* Number of files compiled together by including them in a generated file, files are compiled one by one if not set. */
+extern const char* silk_UNITY_EXCLUDE;       /* Files still compiled one by one when silk_UNITY_BUILD is set. */
+extern const char* silk_PRECOMPILED_HEADER;  /* Header precompiled once and included first by all the files of the project. */
+extern const char* silk_THIN_ARCHIVE;        /* silk_ON to create a static library referencing the objects instead of containing a copy of them. */
+extern const char* silk_LINKER;              /* Linker used instead of the default one (silk_MOLD, silk_LLD, silk_GOLD or silk_AUTO), the default one is used if it's not installed. */
 /* values */
 extern const char* silk_EXE;                 /* silk_BINARY_TYPE value */
 extern const char* silk_SHARED_LIBRARY;      /* silk_BINARY_TYPE value */
 extern const char* silk_STATIC_LIBRARY;      /* silk_BINARY_TYPE value */
+extern const char* silk_TIMESTAMP;           /* silk_REBUILD_MODE value, compile when the source or a header is newer than the object. */
+extern const char* silk_CONTENT_HASH;        /* silk_REBUILD_MODE value, compile when the content of the source, a header or the command changed. */
+extern const char* silk_ON;                  /* Value of the properties which are on or off */
+extern const char* silk_OFF;                 /* Value of the properties which are on or off, default value. */
+extern const char* silk_MOLD;                /* silk_LINKER value */
+extern const char* silk_LLD;                 /* silk_LINKER value */
+extern const char* silk_GOLD;                /* silk_LINKER value */
+extern const char* silk_AUTO;                /* silk_LINKER value, the fastest installed linker. */
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -268,10 +393,24 @@ const char* silk_LFLAGS = "lflags";
 const char* silk_OUTPUT_DIR = "output_dir";
 const char* silk_TARGET_NAME = "target_name";
 const char* silk_WORKING_DIRECTORY = "working_directory";
+const char* silk_REBUILD_MODE = "rebuild_mode";
+const char* silk_UNITY_BUILD = "unity_build";
+const char* silk_UNITY_EXCLUDE = "unity_exclude";
+const char* silk_PRECOMPILED_HEADER = "precompiled_header";
+const char* silk_THIN_ARCHIVE = "thin_archive";
+const char* silk_LINKER = "linker";
 /* values */
 const char* silk_EXE = "exe";
 const char* silk_SHARED_LIBRARY = "shared_library";
 const char* silk_STATIC_LIBRARY = "static_library";
+const char* silk_TIMESTAMP = "timestamp";
+const char* silk_CONTENT_HASH = "content_hash";
+const char* silk_ON = "on";
+const char* silk_OFF = "off";
+const char* silk_MOLD = "mold";
+const char* silk_LLD = "lld";
+const char* silk_GOLD = "gold";
+const char* silk_AUTO = "auto";
 
 /* string view */
 struct silk_strv {
@@ -388,6 +527,7 @@ static silk_context* current_ctx;
 /*-----------------------------------------------------------------------*/
 
 static silk_bool silk_debug_enabled = silk_false;
+static silk_bool silk_buffered_output_enabled = silk_false;
 
 #define silk_set_and_goto(result, value, goto_label) \
 	do { \
@@ -395,19 +535,263 @@ static silk_bool silk_debug_enabled = silk_false;
 		goto goto_label; \
 	} while(0)
 
+/*-----------------------------------------------------------------------*/
+/* silk_thread - threads, mutexes and condition variables */
+/*-----------------------------------------------------------------------*/
+
+typedef void (*silk_thread_fn_t)(void* user_data);
+
+typedef struct silk_thread silk_thread;
+struct silk_thread {
+#ifdef _WIN32
+	HANDLE handle;
+#else
+	pthread_t handle;
+#endif
+	silk_thread_fn_t fn;
+	void* user_data;
+};
+
+#ifdef _WIN32
+typedef CRITICAL_SECTION silk_mutex;
+
+SILK_INTERNAL void silk_mutex_init(silk_mutex* m) { InitializeCriticalSection(m); }
+SILK_INTERNAL void silk_mutex_destroy(silk_mutex* m) { DeleteCriticalSection(m); }
+SILK_INTERNAL void silk_mutex_lock(silk_mutex* m) { EnterCriticalSection(m); }
+SILK_INTERNAL void silk_mutex_unlock(silk_mutex* m) { LeaveCriticalSection(m); }
+
+typedef CONDITION_VARIABLE silk_cond;
+
+SILK_INTERNAL void silk_cond_init(silk_cond* c) { InitializeConditionVariable(c); }
+SILK_INTERNAL void silk_cond_destroy(silk_cond* c) { (void)c; }
+SILK_INTERNAL void silk_cond_wait(silk_cond* c, silk_mutex* m) { SleepConditionVariableCS(c, m, INFINITE); }
+SILK_INTERNAL void silk_cond_broadcast(silk_cond* c) { WakeAllConditionVariable(c); }
+
+SILK_INTERNAL DWORD WINAPI
+silk_thread__proc(LPVOID user_data)
+{
+	silk_thread* thread = (silk_thread*)user_data;
+	thread->fn(thread->user_data);
+	return 0;
+}
+
+SILK_INTERNAL silk_bool
+silk_thread_start(silk_thread* thread, silk_thread_fn_t fn, void* user_data)
+{
+	thread->fn = fn;
+	thread->user_data = user_data;
+	thread->handle = CreateThread(NULL, 0, silk_thread__proc, thread, 0, NULL);
+	return thread->handle != NULL;
+}
+
+SILK_INTERNAL void
+silk_thread_join(silk_thread* thread)
+{
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+}
+
+SILK_INTERNAL silk_size
+silk_cpu_count(void)
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (silk_size)info.dwNumberOfProcessors : 1;
+}
+
+/* Time in milliseconds, only meaningful as a difference between two calls. */
+SILK_INTERNAL double
+silk_time_ms(void)
+{
+	LARGE_INTEGER counter;
+	LARGE_INTEGER frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (double)counter.QuadPart * 1000.0 / (double)frequency.QuadPart;
+}
+#else
+typedef pthread_mutex_t silk_mutex;
+
+SILK_INTERNAL void silk_mutex_init(silk_mutex* m) { pthread_mutex_init(m, NULL); }
+SILK_INTERNAL void silk_mutex_destroy(silk_mutex* m) { pthread_mutex_destroy(m); }
+SILK_INTERNAL void silk_mutex_lock(silk_mutex* m) { pthread_mutex_lock(m); }
+SILK_INTERNAL void silk_mutex_unlock(silk_mutex* m) { pthread_mutex_unlock(m); }
+
+typedef pthread_cond_t silk_cond;
+
+SILK_INTERNAL void silk_cond_init(silk_cond* c) { pthread_cond_init(c, NULL); }
+SILK_INTERNAL void silk_cond_destroy(silk_cond* c) { pthread_cond_destroy(c); }
+SILK_INTERNAL void silk_cond_wait(silk_cond* c, silk_mutex* m) { pthread_cond_wait(c, m); }
+SILK_INTERNAL void silk_cond_broadcast(silk_cond* c) { pthread_cond_broadcast(c); }
+
+SILK_INTERNAL void*
+silk_thread__proc(void* user_data)
+{
+	silk_thread* thread = (silk_thread*)user_data;
+	thread->fn(thread->user_data);
+	return NULL;
+}
+
+/* glibc takes the thread local storage (which holds the temporary allocator) from the stack of the thread,
+   the stack must be big enough for both. */
+#ifndef SILK_THREAD_STACK_SIZE
+#define SILK_THREAD_STACK_SIZE (16 * 1024 * 1024)
+#endif
+
+SILK_INTERNAL silk_bool
+silk_thread_start(silk_thread* thread, silk_thread_fn_t fn, void* user_data)
+{
+	pthread_attr_t attr;
+	int result = 0;
+
+	thread->fn = fn;
+	thread->user_data = user_data;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, SILK_THREAD_STACK_SIZE);
+	result = pthread_create(&thread->handle, &attr, silk_thread__proc, thread);
+	pthread_attr_destroy(&attr);
+
+	return result == 0;
+}
+
+SILK_INTERNAL void
+silk_thread_join(silk_thread* thread)
+{
+	pthread_join(thread->handle, NULL);
+}
+
+SILK_INTERNAL silk_size
+silk_cpu_count(void)
+{
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (silk_size)count : 1;
+}
+
+/* Time in milliseconds, only meaningful as a difference between two calls.
+   Monotonic, the deadlines of the commands don't move when the system clock is set. */
+SILK_INTERNAL double
+silk_time_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1000000.0;
+}
+#endif
+
+/*-----------------------------------------------------------------------*/
+/* job slots - limit the number of commands running at the same time */
+/*-----------------------------------------------------------------------*/
+
+/* Slots are shared by all the workers, projects baked at the same time don't start more commands than allowed. */
+static silk_size silk_job_count = 0; /* 0 means number of online CPUs */
+static silk_size silk_job_running = 0;
+static silk_mutex silk_job_mutex;
+static silk_cond silk_job_cond;
+
+/* Protects what is shared by projects baked at the same time (precompiled headers being built, available linkers). */
+static silk_mutex silk_shared_mutex;
+static silk_dstr silk_pch_claimed; /* Directories of the precompiled headers being checked or built, null-terminated one after the other. */
+static silk_cond silk_pch_cond;    /* Signaled when a precompiled header is released */
+
+SILK_INTERNAL silk_size
+silk_get_job_count(void)
+{
+	return silk_job_count > 0 ? silk_job_count : silk_cpu_count();
+}
+
+/* Tokens of the jobserver, see silk_jobserver below. */
+SILK_INTERNAL void silk_jobserver_setup(void);
+SILK_INTERNAL silk_bool silk_jobserver_is_used(void);
+SILK_INTERNAL silk_bool silk_jobserver_wait_token(void);
+SILK_INTERNAL void silk_jobserver_return_token(void);
+static silk_size silk_job_tokens = 0;  /* Tokens taken from the jobserver, the first command runs with the token of this process. */
+static silk_size silk_job_waiting = 0; /* Threads waiting to start a command */
+static silk_bool silk_job_token_wanted = silk_false; /* A thread is waiting for a token of the jobserver */
+
+/* Give back the tokens nobody needs. Must be called with silk_job_mutex locked. */
+SILK_INTERNAL void
+silk_job_return_extra_tokens(void)
+{
+	while (silk_job_tokens > 0 && silk_job_running < silk_job_tokens + 1 && silk_job_waiting == 0)
+	{
+		silk_jobserver_return_token();
+		silk_job_tokens -= 1;
+	}
+}
+
+/* Wait until a command can be started. */
+SILK_INTERNAL void
+silk_job_acquire(void)
+{
+	silk_bool has_token = silk_false;
+
+	silk_jobserver_setup();
+
+	silk_mutex_lock(&silk_job_mutex);
+	silk_job_waiting += 1;
+	for (;;)
+	{
+		/* Every command after the first one needs a token from the jobserver */
+		if (silk_job_running < silk_get_job_count()
+			&& (!silk_jobserver_is_used() || silk_job_running < silk_job_tokens + 1))
+		{
+			break;
+		}
+
+		if (silk_job_running < silk_get_job_count() && !silk_job_token_wanted)
+		{
+			/* Wait for a token without the lock, so a command finishing in the meantime can be seen. */
+			silk_job_token_wanted = silk_true;
+			silk_mutex_unlock(&silk_job_mutex);
+			has_token = silk_jobserver_wait_token();
+			silk_mutex_lock(&silk_job_mutex);
+			silk_job_token_wanted = silk_false;
+
+			if (has_token)
+			{
+				silk_job_tokens += 1;
+			}
+			silk_cond_broadcast(&silk_job_cond);
+		}
+		else
+		{
+			silk_cond_wait(&silk_job_cond, &silk_job_mutex);
+		}
+	}
+	silk_job_waiting -= 1;
+	silk_job_running += 1;
+	silk_job_return_extra_tokens();
+	silk_mutex_unlock(&silk_job_mutex);
+}
+
+SILK_INTERNAL void
+silk_job_release(void)
+{
+	silk_mutex_lock(&silk_job_mutex);
+	silk_job_running -= 1;
+	silk_job_return_extra_tokens();
+	silk_cond_broadcast(&silk_job_cond);
+	silk_mutex_unlock(&silk_job_mutex);
+}
+
 /*-----------------------------------------------------------------------*/
 /* silk_log */
 /*-----------------------------------------------------------------------*/
 
+/* Messages are formatted with the temporary allocator */
+SILK_INTERNAL silk_size silk_tmp_save(void);
+SILK_INTERNAL void silk_tmp_restore(silk_size index);
+SILK_INTERNAL const char* silk_tmp_vsprintf(const char* format, va_list args);
+
 SILK_INTERNAL void
 silk_log_v(FILE* file, const char* prefix, const char* fmt, va_list args)
 {
-	va_list args_copy;
-	va_copy(args_copy, args);
-
-	fprintf(file, "%s", prefix);
-	vfprintf(file, fmt, args_copy);
-	fprintf(file, "\n");
+	/* The message is written with a single call, the file is locked during each call
+	   so messages written by several threads are never mixed. */
+	silk_size tmp_index = silk_tmp_save();
+	fprintf(file, "%s%s\n", prefix, silk_tmp_vsprintf(fmt, args));
+	silk_tmp_restore(tmp_index);
 }
 
 SILK_INTERNAL void
@@ -423,6 +807,10 @@ silk_log_important(const char* fmt, ...) { va_list args; va_start(args, fmt); si
 /* temporary allocation */
 /*-----------------------------------------------------------------------*/
 
+#ifndef SILK_MAX_COMMAND_LENGTH
+#define SILK_MAX_COMMAND_LENGTH (32 * 1024) /* Longer commands give their arguments through a response file (@file). */
+#endif
+
 #ifndef SILK_TMP_CAPACITY
 #define SILK_TMP_CAPACITY (8 * 1024 * 1024) /* Arbitrary size. Must be big enough. Can be increased if needed. */
 #endif
@@ -793,9 +1181,10 @@ silk_dstr_reserve(silk_dstr* s, silk_size new_string_capacity)
 	SILK_ASSERT(new_data);
 	if (!new_data) { return; }
 
-	if (s->size)
+	/* A cleared string still owns its buffer */
+	memcpy(new_data, s->data, (s->size + 1) * sizeof(char)); /* +1 is for null-terminated string char */
+	if (s->capacity > 0)
 	{
-		memcpy(new_data, s->data, (s->size + 1) * sizeof(char)); /* +1 is for null-terminated string char */
 		SILK_FREE(s->data);
 	}
 
@@ -815,12 +1204,35 @@ SILK_INTERNAL void
 silk_dstr_append_from(silk_dstr* s, silk_size index, const char* data, silk_size size)
 {
 	silk_dstr__grow_if_needed(s, index + size);
+	if (s->capacity == 0)
+	{
+		return; /* Nothing added to the read-only empty string */
+	}
 
 	memcpy(s->data + index, (const void*)data, ((size) * sizeof(char)));
 	s->size = index + size;
 	s->data[s->size] = '\0';
 }
 
+/* Room for 'size' bytes after the end of the string, filled in place (by read() for example) then added with silk_dstr_expand. */
+SILK_INTERNAL char*
+silk_dstr_tail_space(silk_dstr* s, silk_size size)
+{
+	silk_dstr__grow_if_needed(s, s->size + size);
+	return s->data + s->size;
+}
+
+SILK_INTERNAL void
+silk_dstr_expand(silk_dstr* s, silk_size size)
+{
+	if (s->capacity == 0)
+	{
+		return;
+	}
+	s->size += size;
+	s->data[s->size] = '\0';
+}
+
 SILK_INTERNAL silk_size
 silk_dstr_append_from_fv(silk_dstr* s, silk_size index, const char* fmt, va_list args)
 {
@@ -833,6 +1245,10 @@ silk_dstr_append_from_fv(silk_dstr* s, silk_size index, const char* fmt, va_list
 	SILK_ASSERT(add_len >= 0);
 
 	silk_dstr__grow_if_needed(s, s->size + add_len);
+	if (s->capacity == 0)
+	{
+		return 0;
+	}
 
 	add_len = vsnprintf(s->data + index, add_len + 1, fmt, args);
 
@@ -885,6 +1301,16 @@ silk_dstr_append_f(silk_dstr* s, const char* fmt, ...)
 	return len;
 }
 
+/* Append the string including its null-terminating char and returns the offset where it starts.
+   Unlike pointers, offsets remain valid when the dynamic string grows. */
+SILK_INTERNAL silk_size
+silk_dstr_push_str(silk_dstr* s, const char* str)
+{
+	silk_size offset = s->size;
+	silk_dstr_append_from(s, offset, str, strlen(str) + 1);
+	return offset;
+}
+
 /*-----------------------------------------------------------------------*/
 /* silk_hash */
 /*-----------------------------------------------------------------------*/
@@ -909,6 +1335,113 @@ silk_hash_strv(silk_strv sv)
 	return djb2_strv(sv.data, sv.size);
 }
 
+/* 128-bit digest used to detect content changes, djb2 is too weak for that. */
+typedef struct silk_digest silk_digest;
+struct silk_digest {
+	silk_id h[4];
+};
+
+#define SILK_DIGEST_HEX_SIZE 32
+
+#define silk_rotl32(x, r) (((x) << (r)) | ((x) >> (32 - (r))))
+
+SILK_INTERNAL silk_id
+silk_fmix32(silk_id h)
+{
+	h ^= h >> 16;
+	h *= 0x85ebca6bU;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35U;
+	h ^= h >> 16;
+	return h;
+}
+
+/* MurmurHash3 x86_128 (public domain, Austin Appleby), only uses 32-bit arithmetic so it is c89 compliant. */
+SILK_INTERNAL silk_digest
+silk_digest_make(const void* key, silk_size len, silk_id seed)
+{
+	const unsigned char* data = (const unsigned char*)key;
+	const unsigned char* tail = NULL;
+	silk_size nblocks = len / 16;
+	silk_size i = 0;
+	silk_id h1 = seed, h2 = seed, h3 = seed, h4 = seed;
+	silk_id k1 = 0, k2 = 0, k3 = 0, k4 = 0;
+	const silk_id c1 = 0x239b961bU, c2 = 0xab0e9789U, c3 = 0x38b34ae5U, c4 = 0xa1e38b93U;
+	silk_digest digest;
+
+	for (i = 0; i < nblocks; ++i)
+	{
+		memcpy(&k1, data + i * 16 + 0, 4);
+		memcpy(&k2, data + i * 16 + 4, 4);
+		memcpy(&k3, data + i * 16 + 8, 4);
+		memcpy(&k4, data + i * 16 + 12, 4);
+
+		k1 *= c1; k1 = silk_rotl32(k1, 15); k1 *= c2; h1 ^= k1;
+		h1 = silk_rotl32(h1, 19); h1 += h2; h1 = h1 * 5 + 0x561ccd1bU;
+		k2 *= c2; k2 = silk_rotl32(k2, 16); k2 *= c3; h2 ^= k2;
+		h2 = silk_rotl32(h2, 17); h2 += h3; h2 = h2 * 5 + 0x0bcaa747U;
+		k3 *= c3; k3 = silk_rotl32(k3, 17); k3 *= c4; h3 ^= k3;
+		h3 = silk_rotl32(h3, 15); h3 += h4; h3 = h3 * 5 + 0x96cd1c35U;
+		k4 *= c4; k4 = silk_rotl32(k4, 18); k4 *= c1; h4 ^= k4;
+		h4 = silk_rotl32(h4, 13); h4 += h1; h4 = h4 * 5 + 0x32ac3b17U;
+	}
+
+	tail = data + nblocks * 16;
+	k1 = k2 = k3 = k4 = 0;
+
+	switch (len & 15)
+	{
+	case 15: k4 ^= (silk_id)tail[14] << 16; /* fall through */
+	case 14: k4 ^= (silk_id)tail[13] << 8;  /* fall through */
+	case 13: k4 ^= (silk_id)tail[12] << 0;
+		k4 *= c4; k4 = silk_rotl32(k4, 18); k4 *= c1; h4 ^= k4;
+		/* fall through */
+	case 12: k3 ^= (silk_id)tail[11] << 24; /* fall through */
+	case 11: k3 ^= (silk_id)tail[10] << 16; /* fall through */
+	case 10: k3 ^= (silk_id)tail[9] << 8;   /* fall through */
+	case 9:  k3 ^= (silk_id)tail[8] << 0;
+		k3 *= c3; k3 = silk_rotl32(k3, 17); k3 *= c4; h3 ^= k3;
+		/* fall through */
+	case 8: k2 ^= (silk_id)tail[7] << 24; /* fall through */
+	case 7: k2 ^= (silk_id)tail[6] << 16; /* fall through */
+	case 6: k2 ^= (silk_id)tail[5] << 8;  /* fall through */
+	case 5: k2 ^= (silk_id)tail[4] << 0;
+		k2 *= c2; k2 = silk_rotl32(k2, 16); k2 *= c3; h2 ^= k2;
+		/* fall through */
+	case 4: k1 ^= (silk_id)tail[3] << 24; /* fall through */
+	case 3: k1 ^= (silk_id)tail[2] << 16; /* fall through */
+	case 2: k1 ^= (silk_id)tail[1] << 8;  /* fall through */
+	case 1: k1 ^= (silk_id)tail[0] << 0;
+		k1 *= c1; k1 = silk_rotl32(k1, 15); k1 *= c2; h1 ^= k1;
+	}
+
+	h1 ^= (silk_id)len; h2 ^= (silk_id)len; h3 ^= (silk_id)len; h4 ^= (silk_id)len;
+
+	h1 += h2; h1 += h3; h1 += h4;
+	h2 += h1; h3 += h1; h4 += h1;
+
+	h1 = silk_fmix32(h1);
+	h2 = silk_fmix32(h2);
+	h3 = silk_fmix32(h3);
+	h4 = silk_fmix32(h4);
+
+	h1 += h2; h1 += h3; h1 += h4;
+	h2 += h1; h3 += h1; h4 += h1;
+
+	digest.h[0] = h1;
+	digest.h[1] = h2;
+	digest.h[2] = h3;
+	digest.h[3] = h4;
+	return digest;
+}
+
+/* Write the 32 hexadecimal characters of the digest and a null-terminating char. */
+SILK_INTERNAL void
+silk_digest_to_hex(silk_digest digest, char* hex)
+{
+	sprintf(hex, "%08x%08x%08x%08x", digest.h[0], digest.h[1], digest.h[2], digest.h[3]);
+}
+
 /*-----------------------------------------------------------------------*/
 /* silk_kv */
 /*-----------------------------------------------------------------------*/
@@ -1432,6 +1965,43 @@ silk_create_directory(const char* path)
 {
 	return silk__create_directory(silk_utf8_to_utf16(path));
 }
+
+/* Get last modification time of the file in seconds. Returns false if the file does not exist. */
+SILK_INTERNAL silk_bool
+silk_file_mtime(const char* path, double* mtime)
+{
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	silk_size tmp_index = silk_tmp_save();
+	BOOL found = GetFileAttributesExW(silk_utf8_to_utf16(path), GetFileExInfoStandard, &data);
+	silk_tmp_restore(tmp_index);
+
+	if (!found)
+	{
+		return silk_false;
+	}
+
+	/* FILETIME is a number of 100-nanosecond intervals */
+	*mtime = ((double)data.ftLastWriteTime.dwHighDateTime * 4294967296.0 + (double)data.ftLastWriteTime.dwLowDateTime) * 1e-7;
+	return silk_true;
+}
+
+/* Get the size of the file in bytes. Returns false if the file does not exist. */
+SILK_INTERNAL silk_bool
+silk_file_size(const char* path, silk_size* size)
+{
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	silk_size tmp_index = silk_tmp_save();
+	BOOL found = GetFileAttributesExW(silk_utf8_to_utf16(path), GetFileExInfoStandard, &data);
+	silk_tmp_restore(tmp_index);
+
+	if (!found)
+	{
+		return silk_false;
+	}
+
+	*size = (silk_size)data.nFileSizeLow;
+	return silk_true;
+}
 #else
 
 SILK_INTERNAL silk_bool silk_path_exists(const char* path) { return access(path, F_OK) == 0; }
@@ -1440,6 +2010,40 @@ SILK_INTERNAL silk_bool silk_path__exists(const char* path) { return silk_path_e
 SILK_INTERNAL silk_bool silk_create_directory(const char* path) { return mkdir(path, 0777) == 0; }
 SILK_INTERNAL silk_bool silk__create_directory(const char* path) { return silk_create_directory(path); }
 
+/* Get last modification time of the file in seconds. Returns false if the file does not exist. */
+SILK_INTERNAL silk_bool
+silk_file_mtime(const char* path, double* mtime)
+{
+	struct stat st;
+	if (stat(path, &st) != 0)
+	{
+		return silk_false;
+	}
+
+	/* With whole seconds, a file edited in the same second as the previous compilation would look up to date */
+	*mtime = (double)st.st_mtime;
+#if defined(st_mtime) /* st_mtime is a macro when the nanosecond precision st_mtim is available (POSIX.1-2008) */
+	*mtime += (double)st.st_mtim.tv_nsec * 1e-9;
+#elif defined(__GLIBC__) /* Same field, named st_mtimensec when POSIX.1-2008 is hidden */
+	*mtime += (double)st.st_mtimensec * 1e-9;
+#endif
+	return silk_true;
+}
+
+/* Get the size of the file in bytes. Returns false if the file does not exist. */
+SILK_INTERNAL silk_bool
+silk_file_size(const char* path, silk_size* size)
+{
+	struct stat st;
+	if (stat(path, &st) != 0)
+	{
+		return silk_false;
+	}
+
+	*size = (silk_size)st.st_size;
+	return silk_true;
+}
+
 #endif
 
 SILK_INTERNAL silk_bool
@@ -1530,6 +2134,9 @@ silk_path_get_absolute_dir(const char* path)
 	return silk_path_get_absolute_core(path, is_directory);
 }
 
+/* Record a span in the trace, from 'start_time' (silk_time_ms) to now. Defined with silk_trace below. */
+SILK_INTERNAL void silk_trace_add(const char* category, const char* name, double start_time, const char* cmd, const char* output, int exit_code);
+
 /* create directories recursively */
 SILK_INTERNAL void
 silk_create_directories_core(const char* path, silk_size size)
@@ -1541,6 +2148,7 @@ silk_create_directories_core(const char* path, silk_size size)
 	typedef char tchar;
 	char* str = NULL;
 #endif
+	double start_time = 0;
 
 	if (path == NULL || size <= 0) {
 		silk_log_error("Could not create directory. Path is empty.");
@@ -1573,11 +2181,13 @@ silk_create_directories_core(const char* path, silk_size size)
 				*cur = '\0'; /* terminate path at separator */
 				if (!silk_path__exists(str))
 				{
+					start_time = silk_time_ms();
 					if (!silk__create_directory(str))
 					{
 						silk_log_error("Could not create directory.");
 						return;
 					}
+					silk_trace_add("mkdir", path, start_time, NULL, NULL, 0);
 				}
 				*cur = SILK_PREFERRED_DIR_SEPARATOR_CHAR; /* put the separator back */
 			}
@@ -1595,7 +2205,7 @@ silk_create_directories(const char* path, silk_size size)
 }
 
 SILK_INTERNAL silk_bool
-silk_copy_file(const char* src_path, const char* dest_path)
+silk_copy_file_core(const char* src_path, const char* dest_path)
 {
 #ifdef _WIN32
 	/* create target directory if it does not exists */
@@ -1677,6 +2287,15 @@ silk_copy_file(const char* src_path, const char* dest_path)
 #endif
 }
 
+SILK_INTERNAL silk_bool
+silk_copy_file(const char* src_path, const char* dest_path)
+{
+	double start_time = silk_time_ms();
+	silk_bool result = silk_copy_file_core(src_path, dest_path);
+	silk_trace_add("copy", dest_path, start_time, NULL, NULL, result ? 0 : -1);
+	return result;
+}
+
 SILK_INTERNAL silk_bool
 silk_try_copy_file_to_dir(const char* file, const char* directory)
 {
@@ -1709,6 +2328,28 @@ silk_copy_file_to_dir(const char* file, const char* directory)
 }
 
 
+/* Same as silk_copy_file_to_dir but the file is not copied if the destination is already up to date. */
+SILK_INTERNAL silk_bool
+silk_copy_file_to_dir_if_newer(const char* file, const char* directory)
+{
+	silk_bool result = silk_true;
+	silk_size tmp_index = silk_tmp_save();
+	silk_strv filename = silk_path_filename_str(file);
+	const char* destination_file = silk_tmp_sprintf("%s%.*s", directory, filename.size, filename.data);
+	double src_mtime = 0;
+	double dest_mtime = 0;
+
+	if (!silk_file_mtime(file, &src_mtime)
+		|| !silk_file_mtime(destination_file, &dest_mtime)
+		|| src_mtime > dest_mtime)
+	{
+		result = silk_copy_file_to_dir(file, directory);
+	}
+
+	silk_tmp_restore(tmp_index);
+	return result;
+}
+
 SILK_INTERNAL silk_bool
 silk_delete_file(const char* src_path)
 {
@@ -1772,1081 +2413,5895 @@ silk_move_file_to_dir(const char* file, const char* directory)
 	return silk_true;
 }
 
-SILK_API void
-silk_init(void)
+/* Read the whole content of the file into the dynamic string. Returns false if the file could not be opened. */
+SILK_INTERNAL silk_bool
+silk_read_file(const char* path, silk_dstr* content)
 {
-	silk_context_init(&default_ctx);
-	current_ctx = &default_ctx;
-#ifdef _WIN32
-	silk_bool exit_on_exception = silk_true; /* @TODO make this configurable */
-	if (exit_on_exception)
+	silk_size bytes_read = 0;
+	FILE* file = fopen(path, "rb");
+
+	if (!file)
 	{
-		SetUnhandledExceptionFilter(exit_on_exception_handler);
+		return silk_false;
 	}
-#endif
-}
 
-SILK_API void
-silk_destroy(void)
-{
-	silk_context_destroy(silk_current_context());
-	silk_tmp_reset();
+	silk_dstr_clear(content);
+	do
+	{
+		silk_dstr__grow_if_needed(content, content->size + 64 * 1024);
+		bytes_read = fread(content->data + content->size, 1, content->capacity - content->size, file);
+		content->size += bytes_read;
+		content->data[content->size] = '\0';
+	} while (bytes_read > 0);
+
+	fclose(file);
+	return silk_true;
 }
 
-SILK_API void
-silk_clear(void)
+/* Create or replace the file with the data. */
+SILK_INTERNAL silk_bool
+silk_write_file(const char* path, const char* data, silk_size size)
 {
-	silk_context_clear(silk_current_context());
-	silk_tmp_reset();
+	silk_bool result = silk_false;
+	FILE* file = fopen(path, "wb");
+
+	if (!file)
+	{
+		silk_log_error("Could not open file '%s' for writing.", path);
+		return silk_false;
+	}
+
+	result = fwrite(data, 1, size, file) == size;
+	result = (fclose(file) == 0) && result;
+
+	if (!result)
+	{
+		silk_log_error("Could not write file '%s'.", path);
+	}
+	return result;
 }
 
-SILK_API silk_project_t*
-silk_project(const char* name)
+/* Add the data at the end of the file, the file is created if needed. */
+SILK_INTERNAL silk_bool
+silk_append_file(const char* path, const char* data, silk_size size)
 {
-	silk_project_t* project;
+	silk_bool result = silk_false;
+	FILE* file = fopen(path, "ab");
 
-	if (!silk_try_find_project_by_name_str(name, &project))
+	if (!file)
 	{
-		project = silk_create_project(name);
+		silk_log_error("Could not open file '%s' for writing.", path);
+		return silk_false;
 	}
 
-	silk_current_context()->current_project = project;
-	return project;
+	result = fwrite(data, 1, size, file) == size;
+	result = (fclose(file) == 0) && result;
+
+	if (!result)
+	{
+		silk_log_error("Could not write file '%s'.", path);
+	}
+	return result;
 }
 
-SILK_API silk_project_t*
-silk_project_f(const char* format, ...)
+/* Same as silk_write_file but the file is kept as is if it already contains the data, so it does not look modified.
+   'buffer' is used to read the existing file. */
+SILK_INTERNAL silk_bool
+silk_write_file_if_changed(const char* path, const char* data, silk_size size, silk_dstr* buffer)
 {
-	silk_project_t* p;
-	va_list args;
-	va_start(args, format);
+	if (silk_read_file(path, buffer) && buffer->size == size && memcmp(buffer->data, data, size) == 0)
+	{
+		return silk_true;
+	}
+	return silk_write_file(path, data, size);
+}
 
-	p = silk_project(silk_tmp_vsprintf(format, args));
+/*-----------------------------------------------------------------------*/
+/* silk_file_cache - modification time and digest of files, each file is only checked once */
+/*-----------------------------------------------------------------------*/
 
-	va_end(args);
+typedef struct silk_file_entry silk_file_entry;
+struct silk_file_entry {
+	silk_size offset; /* Offset of the path in the 'paths' of the cache, SILK_NPOS if the slot is empty. */
+	silk_id hash;
+	silk_bool exists;
+	silk_bool has_digest; /* The digest is only computed when requested */
+	double mtime;
+	silk_digest digest;
+};
 
-	return p;
-}
+/* Open addressing hash table, the capacity is always a power of two. */
+typedef struct silk_file_cache silk_file_cache;
+struct silk_file_cache {
+	silk_dstr paths;   /* Null-terminated paths one after the other. */
+	silk_dstr content; /* Buffer to read the files to compute their digest. */
+	silk_file_entry* entries;
+	silk_size capacity;
+	silk_size count;
+};
 
-SILK_API void
-silk_add_many_core(silk_strv key, silk_strv values[], silk_size count)
+SILK_INTERNAL void
+silk_file_cache__alloc(silk_file_cache* cache, silk_size capacity)
 {
-	silk_size i;
-	silk_strv value = { 0 };
-	/* Check that the ptr is contains in the tmp buffer */
-	SILK_ASSERT(silk_tmp_contains(key.data));
-
-	for (i = 0; i < count; ++i)
+	silk_size i = 0;
+	cache->entries = (silk_file_entry*)SILK_MALLOC(capacity * sizeof(silk_file_entry));
+	SILK_ASSERT(cache->entries);
+	cache->capacity = capacity;
+	for (i = 0; i < capacity; ++i)
 	{
-		value = values[i];
-		/* Check that the ptr is contains in the tmp buffer */
-		SILK_ASSERT(silk_tmp_contains(value.data));
-		
-		silk_mmap_insert(
-			&silk_current_project()->mmap,
-			silk_kv_make_with_strv(key, value));
+		cache->entries[i].offset = SILK_NPOS;
 	}
 }
 
 SILK_INTERNAL void
-silk_add_many(const char* key, const char* values[], silk_size count)
+silk_file_cache_init(silk_file_cache* cache)
 {
-	silk_size i;
-	silk_strv value = { 0 };
+	memset(cache, 0, sizeof(silk_file_cache));
+	silk_dstr_init(&cache->paths);
+	silk_dstr_init(&cache->content);
+	silk_file_cache__alloc(cache, 256);
+}
 
-	for (i = 0; i < count; ++i)
+SILK_INTERNAL void
+silk_file_cache_destroy(silk_file_cache* cache)
+{
+	silk_dstr_destroy(&cache->paths);
+	silk_dstr_destroy(&cache->content);
+	SILK_FREE(cache->entries);
+	memset(cache, 0, sizeof(silk_file_cache));
+}
+
+SILK_INTERNAL void
+silk_file_cache__grow(silk_file_cache* cache)
+{
+	silk_file_entry* old_entries = cache->entries;
+	silk_size old_capacity = cache->capacity;
+	silk_size i = 0;
+	silk_size index = 0;
+
+	silk_file_cache__alloc(cache, old_capacity * 2);
+
+	for (i = 0; i < old_capacity; ++i)
 	{
-		value = silk_tmp_str_to_strv(values[i]);
-		silk_add_many_core(silk_tmp_str_to_strv(key), &value, 1);
+		if (old_entries[i].offset != SILK_NPOS)
+		{
+			index = old_entries[i].hash & (cache->capacity - 1);
+			while (cache->entries[index].offset != SILK_NPOS)
+			{
+				index = (index + 1) & (cache->capacity - 1);
+			}
+			cache->entries[index] = old_entries[i];
+		}
 	}
+
+	SILK_FREE(old_entries);
 }
 
-SILK_API void
-silk_add_many_vnull(const char* key, ...)
+/* Find the entry of the file, the entry is created if the file is not in the cache yet. */
+SILK_INTERNAL silk_file_entry*
+silk_file_cache__get(silk_file_cache* cache, const char* path)
 {
-	silk_strv value;
-	va_list args;
-	const char* current = NULL;
-	va_start(args, key);
+	silk_size size = strlen(path);
+	silk_id hash = djb2_strv(path, size);
+	silk_size index = 0;
+	silk_file_entry* entry = NULL;
 
-	current = va_arg(args, const char*);
-	SILK_ASSERT(current);
-	while (current)
+	/* Keep the load factor under 0.5 */
+	if ((cache->count + 1) * 2 >= cache->capacity)
 	{
-		value = silk_tmp_str_to_strv(current);
-		silk_add_many_core(silk_tmp_str_to_strv(key), &value, 1);
-		current = va_arg(args, const char*);
+		silk_file_cache__grow(cache);
 	}
-	va_end(args);
+
+	index = hash & (cache->capacity - 1);
+	for (;;)
+	{
+		entry = &cache->entries[index];
+		if (entry->offset == SILK_NPOS)
+		{
+			break; /* not found */
+		}
+		if (entry->hash == hash && strcmp(cache->paths.data + entry->offset, path) == 0)
+		{
+			return entry;
+		}
+		index = (index + 1) & (cache->capacity - 1);
+	}
+
+	memset(entry, 0, sizeof(silk_file_entry));
+	entry->hash = hash;
+	entry->offset = silk_dstr_push_str(&cache->paths, path);
+	entry->exists = silk_file_mtime(path, &entry->mtime);
+	cache->count += 1;
+
+	return entry;
 }
 
-SILK_API void
-silk_add(const char* key, const char* value)
+/* Get the modification time of the file. Returns false if the file does not exist. */
+SILK_INTERNAL silk_bool
+silk_file_cache_mtime(silk_file_cache* cache, const char* path, double* mtime)
 {
-	silk_strv value_copy = silk_tmp_str_to_strv(value);
-	silk_add_many_core(silk_tmp_str_to_strv(key), &value_copy, 1);
+	silk_file_entry* entry = silk_file_cache__get(cache, path);
+	*mtime = entry->mtime;
+	return entry->exists;
 }
 
-SILK_API void
-silk_add_f(const char* key, const char* format, ...)
+/* Get the digest of the content of the file. Returns false if the file could not be read. */
+SILK_INTERNAL silk_bool
+silk_file_cache_digest(silk_file_cache* cache, const char* path, silk_digest* digest)
 {
-	silk_strv value;
-	va_list args;
-	va_start(args, format);
+	silk_file_entry* entry = silk_file_cache__get(cache, path);
 
-	value = silk_tmp_strv_vprintf(format, args);
-	silk_add_many_core(silk_tmp_str_to_strv(key), &value, 1);
+	if (entry->exists && !entry->has_digest)
+	{
+		if (silk_read_file(path, &cache->content))
+		{
+			entry->digest = silk_digest_make(cache->content.data, cache->content.size, 0);
+			entry->has_digest = silk_true;
+		}
+	}
 
-	va_end(args);
+	*digest = entry->digest;
+	return entry->has_digest;
 }
 
-SILK_API void
-silk_set(const char* key, const char* value)
+/*-----------------------------------------------------------------------*/
+/* silk_db - what the previous builds of a project recorded, kept in its output directory */
+/*-----------------------------------------------------------------------*/
+
+/* The database is a list of records, a key and a value, the last record of a key wins.
+   Records are appended by batches, each batch ends with a commit record holding the digest of the batch,
+   a batch torn by a crash does not match its digest so it's ignored, and so is everything after it.
+   Once the appended records are bigger than the rest, the database is rewritten with the last record of each key
+   followed by the offsets of the records sorted by key. This part is used where it's mapped, without reading it.
+
+   "SILKDB01" <index offset> <index count>
+   <key size> <value size> <key> <value>      last record of each key, sorted by key
+   ...
+   <record offset> ...                        index, one per record
+   <key size> <value size> <key> <value>      records appended since then
+   ...
+   <SILK_DB_COMMIT> <16> <digest of the batch>
+   Numbers are 32-bit, in the byte order of the machine. */
+#define SILK_DB_MAGIC "SILKDB01"
+#define SILK_DB_HEADER_SIZE 16
+#define SILK_DB_COMMIT 0xFFFFFFFFU
+#define SILK_DB_COMPACT_SLACK (64 * 1024) /* Appended bytes allowed beyond the size of the sorted part */
+
+typedef struct silk_db_entry silk_db_entry;
+struct silk_db_entry {
+	silk_strv key;   /* In the mapped file */
+	silk_strv value;
+	silk_size order; /* Position of the record, the last record of a key wins. */
+};
+
+typedef struct silk_db silk_db;
+struct silk_db {
+	silk_dstr path;
+	const char* data;               /* Content of the file, mapped */
+	silk_size size;
+	silk_size valid_size;           /* End of the last valid commit, what follows is dropped by the next commit. */
+	const char* index;              /* Offsets of the sorted records */
+	silk_size index_count;
+	silk_size tail_offset;          /* Beginning of the appended records */
+	silk_darrT(silk_db_entry) tail; /* Last appended record of each key, sorted by key. */
+	silk_dstr pending;              /* Records added since the last commit */
+};
+
+typedef struct silk_db_range silk_db_range;
+struct silk_db_range {
+	const silk_db* db;
+	silk_strv prefix;
+	silk_size index_pos;
+	silk_size tail_pos;
+};
+
+SILK_INTERNAL unsigned int
+silk_db_read_u32(const char* data)
 {
-	/* @OPT this can easily be optimized, but we don't care about that right now. */
-	silk_remove_all(key);
-	silk_add(key, value);
+	unsigned int value = 0;
+	memcpy(&value, data, 4);
+	return value;
 }
 
-SILK_API void
-silk_set_f(const char* key, const char* format, ...)
+SILK_INTERNAL void
+silk_db_append_u32(silk_dstr* dstr, unsigned int value)
 {
-	va_list args;
-	va_start(args, format);
-
-	silk_set(key, silk_tmp_vsprintf(format, args));
+	silk_dstr_append_from(dstr, dstr->size, (const char*)&value, 4);
+}
 
-	va_end(args);
+/* Same order as memcmp, it's stored in the file so it must never change. */
+SILK_INTERNAL int
+silk_db_key_compare(silk_strv left, silk_strv right)
+{
+	int result = memcmp(left.data, right.data, left.size < right.size ? left.size : right.size);
+	if (result != 0)
+	{
+		return result;
+	}
+	return left.size < right.size ? -1 : (left.size > right.size ? 1 : 0);
 }
 
-SILK_API silk_size
-silk_remove_all(const char* key)
+SILK_INTERNAL int
+silk_db_entry_compare(const void* left, const void* right)
 {
-	silk_kv kv = silk_kv_make_with_str(silk_strv_make_str(key), "");
-	silk_project_t* p = silk_current_project();
-	return silk_mmap_remove(&p->mmap, kv);
+	const silk_db_entry* l = (const silk_db_entry*)left;
+	const silk_db_entry* r = (const silk_db_entry*)right;
+	int result = silk_db_key_compare(l->key, r->key);
+
+	if (result != 0)
+	{
+		return result;
+	}
+	return l->order < r->order ? -1 : (l->order > r->order ? 1 : 0);
 }
 
-SILK_API silk_size
-silk_remove_all_f(const char* format, ...)
+/* Read the record at 'offset'. Returns the offset of the next record, 0 if the record does not fit in the data. */
+SILK_INTERNAL silk_size
+silk_db_read_record(const char* data, silk_size size, silk_size offset, unsigned int* key_size, silk_strv* key, silk_strv* value)
 {
-	va_list args;
-	silk_size count = 0;
-	va_start(args, format);
+	unsigned int value_size = 0;
+	silk_size key_length = 0;
 
-	count = silk_remove_all(silk_tmp_vsprintf(format, args));
+	if (offset < SILK_DB_HEADER_SIZE || offset > size || size - offset < 8)
+	{
+		return 0;
+	}
 
-	va_end(args);
-	return count;
+	*key_size = silk_db_read_u32(data + offset);
+	value_size = silk_db_read_u32(data + offset + 4);
+	key_length = *key_size == SILK_DB_COMMIT ? 0 : *key_size;
+	if (value_size > size - (offset + 8) || key_length > size - (offset + 8) - value_size)
+	{
+		return 0;
+	}
+	*key = silk_strv_make(data + offset + 8, key_length);
+	*value = silk_strv_make(key->data + key->size, value_size);
+	return offset + 8 + key->size + value_size;
 }
 
-SILK_API silk_bool
-silk_contains(const char* key, const char* value)
+/* Key of the 'i'th record of the index, empty if the record can't be read (silk_db_open checks them all). */
+SILK_INTERNAL silk_strv
+silk_db_index_key(const silk_db* db, silk_size i, silk_strv* value)
 {
-	silk_project_t* p;
-	silk_kv_range range;
-	silk_kv kv = silk_kv_make_with_str(silk_strv_make_str(key), value);
-	p = silk_current_project();
-	range = silk_mmap_get_range(&p->mmap, kv.key);
+	unsigned int key_size = 0;
+	silk_strv key = { 0 };
 
-	while (range.begin < range.end)
+	if (silk_db_read_record(db->data, db->size, silk_db_read_u32(db->index + i * 4), &key_size, &key, value) == 0)
 	{
-		if (silk_strv_equals_strv((*range.begin).u.strv, kv.u.strv))
-		{
-			return silk_true;
-		}
-		range.begin++;
+		key = silk_strv_make("", 0);
+		*value = key;
 	}
-	return silk_false;
+	return key;
 }
 
-SILK_API silk_bool
-silk_remove_one(const char* key, const char* value)
+SILK_INTERNAL silk_size
+silk_db_index_lower_bound(const silk_db* db, silk_strv key)
 {
-	silk_kv kv = silk_kv_make_with_str(silk_strv_make_str(key), value);
-	silk_project_t* p = silk_current_project();
-	silk_kv_range range = silk_mmap_get_range(&p->mmap, kv.key);
+	silk_strv value;
+	silk_size first = 0;
+	silk_size last = db->index_count;
+	silk_size middle = 0;
 
-	while (range.begin < range.end)
+	while (first < last)
 	{
-		if (silk_strv_equals_strv((*range.begin).u.strv, kv.u.strv))
+		middle = first + (last - first) / 2;
+		if (silk_db_key_compare(silk_db_index_key(db, middle, &value), key) < 0)
 		{
-			silk_size index = p->mmap.darr.data - range.begin;
-			silk_darrT_remove(&p->mmap, index);
-			return silk_true;
+			first = middle + 1;
+		}
+		else
+		{
+			last = middle;
 		}
-		range.begin++;
 	}
-	return silk_false;
+	return first;
 }
 
-SILK_API silk_bool
-silk_remove_one_f(const char* key, const char* format, ...)
+SILK_INTERNAL silk_size
+silk_db_tail_lower_bound(const silk_db* db, silk_strv key)
 {
-	va_list args;
-	silk_bool was_removed = silk_false;
-	va_start(args, format);
-
-	was_removed = silk_remove_one(key, silk_tmp_vsprintf(format, args));
+	silk_size first = 0;
+	silk_size last = silk_darrT_size(&db->tail);
+	silk_size middle = 0;
 
-	va_end(args);
-	return was_removed;
+	while (first < last)
+	{
+		middle = first + (last - first) / 2;
+		if (silk_db_key_compare(silk_darrT_at(&db->tail, middle).key, key) < 0)
+		{
+			first = middle + 1;
+		}
+		else
+		{
+			last = middle;
+		}
+	}
+	return first;
 }
 
-SILK_API void
-silk_add_file(const char* file)
+SILK_INTERNAL void
+silk_db_init(silk_db* db)
 {
-	silk_add(silk_FILES, file);
+	memset(db, 0, sizeof(silk_db));
+	silk_dstr_init(&db->path);
+	silk_darrT_init(&db->tail);
+	silk_dstr_init(&db->pending);
 }
 
-/* Properties are just (strv) values from the map of a project. */
-SILK_INTERNAL silk_bool
-try_get_property(silk_project_t* project, const char* key, silk_kv* result)
+SILK_INTERNAL void
+silk_db_close(silk_db* db)
 {
-	if (silk_mmap_try_get_first(&project->mmap, silk_strv_make_str(key), result))
+	if (db->data)
 	{
-		return silk_true;
+#ifdef _WIN32
+		UnmapViewOfFile(db->data);
+#else
+		munmap((void*)db->data, db->size);
+#endif
 	}
-	return silk_false;
+	db->data = NULL;
+	db->size = 0;
+	db->valid_size = 0;
+	db->index = NULL;
+	db->index_count = 0;
+	db->tail_offset = 0;
+	db->tail.darr.size = 0;
 }
 
-SILK_INTERNAL silk_bool
-try_get_property_strv(silk_project_t* project, const char* key, silk_strv* result)
+SILK_INTERNAL void
+silk_db_destroy(silk_db* db)
 {
-	silk_kv kv_result;
-	if (silk_mmap_try_get_first(&project->mmap, silk_strv_make_str(key), &kv_result))
-	{
-		*result = kv_result.u.strv;
-		return silk_true;
-	}
-	return silk_false;
+	silk_db_close(db);
+	silk_dstr_destroy(&db->path);
+	silk_darrT_destroy(&db->tail);
+	silk_dstr_destroy(&db->pending);
 }
 
-SILK_INTERNAL silk_bool
-silk_property_equals(silk_project_t* project, const char* key, const char* comparison_value)
+/* Each project has its own database, so the projects sharing an output directory do not rewrite the same file. */
+SILK_INTERNAL const char*
+silk_db_path(const char* output_dir, const char* project_name)
 {
-	silk_strv result;
-	return try_get_property_strv(project, key, &result)
-		&& silk_strv_equals_str(result, comparison_value);
+	return silk_tmp_sprintf("%ssilk_%s.db", output_dir, project_name);
 }
 
-SILK_API const char*
-silk_bake_project_with(silk_toolchain toolchain, const char* project_name)
-{
-	const char* result = toolchain.bake(&toolchain, project_name);
-	silk_log_important("%s", result);
-	return result;
+/* Map the database. Only the records appended since it was last sorted are read.
+   Returns false if there is no database yet, or if it's not recognized, it's replaced by the next commit then. */
+SILK_INTERNAL silk_bool
+silk_db_open(silk_db* db, const char* path)
+{
+	silk_db_entry entry;
+	silk_strv digest_value;
+	silk_digest digest;
+	unsigned int key_size = 0;
+	silk_size offset = 0;
+	silk_size next = 0;
+	silk_size batch_offset = 0;
+	silk_size batch_entries = 0; /* Entries of the valid batches */
+	silk_size i = 0;
+	silk_size count = 0;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+	LARGE_INTEGER file_size;
+#else
+	struct stat st;
+	void* map = NULL;
+	int fd = -1;
+#endif
+
+	silk_db_close(db);
+	silk_dstr_assign_str(&db->path, path);
+
+#ifdef _WIN32
+	file = CreateFileW(silk_utf8_to_utf16(path), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return silk_false;
+	}
+	/* An empty file can't be mapped. The view keeps the mapping alive once the handles are closed. */
+	if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0)
+	{
+		mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping != NULL)
+		{
+			db->data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			db->size = db->data ? (silk_size)file_size.QuadPart : 0;
+			CloseHandle(mapping);
+		}
+	}
+	CloseHandle(file);
+#else
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+	{
+		return silk_false;
+	}
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+	{
+		map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED)
+		{
+			db->data = (const char*)map;
+			db->size = (silk_size)st.st_size;
+		}
+	}
+	close(fd);
+#endif
+
+	if (db->size < SILK_DB_HEADER_SIZE || memcmp(db->data, SILK_DB_MAGIC, 8) != 0)
+	{
+		return silk_false;
+	}
+
+	offset = silk_db_read_u32(db->data + 8);
+	db->index_count = silk_db_read_u32(db->data + 12);
+	if (offset < SILK_DB_HEADER_SIZE || offset > db->size || db->index_count > (db->size - offset) / 4)
+	{
+		db->index_count = 0;
+		return silk_false;
+	}
+	db->index = db->data + offset;
+	db->tail_offset = offset + db->index_count * 4;
+
+	/* The sorted records are read where they are, each one must be between the header and the index.
+	   A damaged database is ignored, the next commit replaces it. */
+	for (i = 0; i < db->index_count; ++i)
+	{
+		if (silk_db_read_record(db->data, offset, silk_db_read_u32(db->index + i * 4), &key_size, &entry.key, &entry.value) == 0
+			|| key_size == SILK_DB_COMMIT)
+		{
+			db->index_count = 0;
+			return silk_false;
+		}
+	}
+
+	/* The records of a batch are kept once its commit record is found and matches them */
+	db->valid_size = db->tail_offset;
+	batch_offset = db->tail_offset;
+	for (offset = db->tail_offset; (next = silk_db_read_record(db->data, db->size, offset, &key_size, &entry.key, &entry.value)) != 0; offset = next)
+	{
+		if (key_size != SILK_DB_COMMIT)
+		{
+			entry.order = count++;
+			silk_darrT_push_back(&db->tail, entry);
+			continue;
+		}
+
+		digest_value = entry.value;
+		digest = silk_digest_make(db->data + batch_offset, offset - batch_offset, 0);
+		if (digest_value.size != sizeof(digest.h) || memcmp(digest_value.data, digest.h, sizeof(digest.h)) != 0)
+		{
+			break;
+		}
+		db->valid_size = next;
+		batch_offset = next;
+		batch_entries = silk_darrT_size(&db->tail);
+	}
+	db->tail.darr.size = batch_entries;
+
+	/* Only keep the last record of each key */
+	qsort(db->tail.darr.data, silk_darrT_size(&db->tail), sizeof(silk_db_entry), silk_db_entry_compare);
+	count = 0;
+	for (i = 0; i < silk_darrT_size(&db->tail); ++i)
+	{
+		if (i + 1 == silk_darrT_size(&db->tail)
+			|| silk_db_key_compare(silk_darrT_at(&db->tail, i).key, silk_darrT_at(&db->tail, i + 1).key) != 0)
+		{
+			silk_darrT_at(&db->tail, count) = silk_darrT_at(&db->tail, i);
+			count += 1;
+		}
+	}
+	db->tail.darr.size = count;
+
+	return silk_true;
 }
 
-SILK_API const char*
-silk_bake_project(const char* project_name)
+/* Get the value of the last committed record of the key. Returns false if there is none.
+   The value is in the mapped file, it's valid until the database is committed or closed. */
+SILK_INTERNAL silk_bool
+silk_db_get(const silk_db* db, const char* key, silk_strv* value)
 {
-	return silk_bake_project_with(silk_toolchain_default(), project_name);
+	silk_strv k = silk_strv_make_str(key);
+	silk_size i = 0;
+
+	i = silk_db_tail_lower_bound(db, k);
+	if (i < silk_darrT_size(&db->tail) && silk_db_key_compare(silk_darrT_at(&db->tail, i).key, k) == 0)
+	{
+		*value = silk_darrT_at(&db->tail, i).value;
+		return silk_true;
+	}
+
+	i = silk_db_index_lower_bound(db, k);
+	return i < db->index_count && silk_db_key_compare(silk_db_index_key(db, i, value), k) == 0;
 }
 
-SILK_API const char*
-silk_bake(void)
+/* Records of the keys starting with 'prefix', sorted by key. */
+SILK_INTERNAL silk_db_range
+silk_db_get_range(const silk_db* db, const char* prefix)
 {
-	silk_project_t* p = silk_current_project();
-	return silk_bake_project(p->name.data);
+	silk_db_range range;
+	range.db = db;
+	range.prefix = silk_strv_make_str(prefix);
+	range.index_pos = silk_db_index_lower_bound(db, range.prefix);
+	range.tail_pos = silk_db_tail_lower_bound(db, range.prefix);
+	return range;
 }
 
-SILK_INTERNAL const char*
-silk_get_output_directory(silk_project_t* project, const silk_toolchain* tc)
+SILK_INTERNAL silk_bool
+silk_db_range_get_next(silk_db_range* range, silk_strv* key, silk_strv* value)
 {
-	silk_strv out_dir;
-	if (try_get_property_strv(project, silk_OUTPUT_DIR, &out_dir))
+	silk_strv index_key = { 0 };
+	silk_strv index_value = { 0 };
+	silk_strv tail_key = { 0 };
+	silk_bool has_index = silk_false;
+	silk_bool has_tail = silk_false;
+	int order = 0;
+
+	if (range->index_pos < range->db->index_count)
 	{
-		return silk_path_get_absolute_dir(out_dir.data);
+		index_key = silk_db_index_key(range->db, range->index_pos, &index_value);
+		has_index = index_key.size >= range->prefix.size && memcmp(index_key.data, range->prefix.data, range->prefix.size) == 0;
 	}
-	else
+
+	if (range->tail_pos < silk_darrT_size(&range->db->tail))
 	{
-		/* Get default output directory */
-		return silk_path_get_absolute_dir(silk_path_combine(tc->default_directory_base, project->name.data));
+		tail_key = silk_darrT_at(&range->db->tail, range->tail_pos).key;
+		has_tail = tail_key.size >= range->prefix.size && memcmp(tail_key.data, range->prefix.data, range->prefix.size) == 0;
+	}
+
+	if (!has_index && !has_tail)
+	{
+		return silk_false;
+	}
+
+	/* An appended record replaces the sorted one of the same key */
+	order = has_index && has_tail ? silk_db_key_compare(index_key, tail_key) : (has_index ? -1 : 1);
+	if (order < 0)
+	{
+		*key = index_key;
+		*value = index_value;
+		range->index_pos += 1;
+		return silk_true;
 	}
+
+	*key = tail_key;
+	*value = silk_darrT_at(&range->db->tail, range->tail_pos).value;
+	range->index_pos += order == 0 ? 1 : 0;
+	range->tail_pos += 1;
+	return silk_true;
 }
 
-SILK_API void
-silk_debug(silk_bool value)
+/* The record is written by the next commit */
+SILK_INTERNAL void
+silk_db_put(silk_db* db, const char* key, const void* value, silk_size size)
 {
-	silk_debug_enabled = value;
+	silk_db_append_u32(&db->pending, (unsigned int)strlen(key));
+	silk_db_append_u32(&db->pending, (unsigned int)size);
+	silk_dstr_append_from(&db->pending, db->pending.size, key, strlen(key));
+	silk_dstr_append_from(&db->pending, db->pending.size, (const char*)value, size);
 }
 
-struct silk_process_handle {
-	const char* cmd;
-	const char* starting_directory;
-	silk_bool stdout_to_string; /* If stdout needs to be copied to a string. */
-	silk_bool stderr_to_string; /* If stderr needs to be copied to a string. */
-	silk_dstr stdout_string;    /* If stdout_to_string has been set to true. */
-	silk_dstr stderr_string;    /* If stderr_to_string has been set to true. */
-	int exit_code;
-};
+/* Rewrite the database with the last record of each key, sorted. The new file replaces the old one at once, then it's mapped. */
+SILK_INTERNAL silk_bool
+silk_db_compact(silk_db* db)
+{
+	silk_dstr content;
+	silk_darrT(silk_size) offsets;
+	silk_db_range range;
+	silk_strv key;
+	silk_strv value;
+	const char* partial = NULL;
+	silk_bool result = silk_false;
+	silk_size tmp_index = 0;
+	silk_size i = 0;
+	unsigned int header = 0; /* Index offset and count */
 
-SILK_INTERNAL silk_process_handle* silk_process_core(silk_process_handle* handle);
+	silk_dstr_init(&content);
+	silk_darrT_init(&offsets);
 
-SILK_INTERNAL silk_process_handle*
-silk_create_process_handle(const char* cmd, const char* starting_directory)
-{
-	silk_process_handle* handle = (silk_process_handle*)silk_tmp_alloc(sizeof(silk_process_handle));
-	memset(handle, 0, sizeof(silk_process_handle));
+	silk_dstr_append_from(&content, 0, SILK_DB_MAGIC, 8);
+	silk_db_append_u32(&content, 0);
+	silk_db_append_u32(&content, 0);
 
-	handle->cmd = cmd;
-	handle->starting_directory = starting_directory;
-	handle->exit_code = -1;
+	range = silk_db_get_range(db, "");
+	while (silk_db_range_get_next(&range, &key, &value))
+	{
+		silk_darrT_push_back(&offsets, content.size);
+		silk_db_append_u32(&content, (unsigned int)key.size);
+		silk_db_append_u32(&content, (unsigned int)value.size);
+		silk_dstr_append_from(&content, content.size, key.data, key.size);
+		silk_dstr_append_from(&content, content.size, value.data, value.size);
+	}
 
-	silk_dstr_init(&handle->stdout_string);
-	silk_dstr_init(&handle->stderr_string);
+	header = (unsigned int)content.size;
+	memcpy(content.data + 8, &header, 4);
+	header = (unsigned int)silk_darrT_size(&offsets);
+	memcpy(content.data + 12, &header, 4);
+	for (i = 0; i < silk_darrT_size(&offsets); ++i)
+	{
+		silk_db_append_u32(&content, (unsigned int)silk_darrT_at(&offsets, i));
+	}
 
-	return handle;
-}
+	/* Readers see the old database or the new one, never a partial one */
+	tmp_index = silk_tmp_save();
+	partial = silk_tmp_sprintf("%s.partial", db->path.data);
+	result = silk_write_file(partial, content.data, content.size);
+#ifdef _WIN32
+	silk_db_close(db); /* A mapped file can't be deleted */
+	silk_delete_file(db->path.data);
+#endif
+	result = result && rename(partial, db->path.data) == 0;
+	silk_tmp_restore(tmp_index);
 
-SILK_API int
-silk_process(const char* cmd)
-{
-	return silk_process_in_directory(cmd, NULL);
-}
+	silk_db_open(db, db->path.data);
 
-SILK_API int
-silk_process_in_directory(const char* cmd, const char* starting_directory)
-{
-	silk_process_handle* handle = silk_create_process_handle(cmd, starting_directory);
-	handle = silk_process_core(handle);
-	return silk_process_end(handle);
+	silk_dstr_destroy(&content);
+	silk_darrT_destroy(&offsets);
+	return result;
 }
 
-SILK_API silk_process_handle*
-silk_process_to_string(const char* cmd, const char* starting_directory, silk_bool also_get_stderr)
+/* Write the records added since the last commit, then map the database again. */
+SILK_INTERNAL silk_bool
+silk_db_commit(silk_db* db)
 {
-	silk_process_handle* handle = silk_create_process_handle(cmd, starting_directory);
+	silk_dstr batch;
+	silk_digest digest;
+	silk_bool result = silk_true;
 
-	handle->stdout_to_string = silk_true;
-	handle->stderr_to_string = also_get_stderr;
+	if (db->pending.size == 0)
+	{
+		return silk_true;
+	}
 
-	return silk_process_core(handle);
+	silk_dstr_init(&batch);
+
+	/* A batch torn by a crash, or a database which is not recognized, is dropped first */
+	if (db->size > 0 && db->valid_size < db->size)
+	{
+		result = silk_db_compact(db);
+	}
+
+	if (db->size == 0)
+	{
+		silk_dstr_append_from(&batch, 0, SILK_DB_MAGIC, 8);
+		silk_db_append_u32(&batch, SILK_DB_HEADER_SIZE);
+		silk_db_append_u32(&batch, 0);
+	}
+
+	digest = silk_digest_make(db->pending.data, db->pending.size, 0);
+	silk_dstr_append_from(&batch, batch.size, db->pending.data, db->pending.size);
+	silk_db_append_u32(&batch, SILK_DB_COMMIT);
+	silk_db_append_u32(&batch, sizeof(digest.h));
+	silk_dstr_append_from(&batch, batch.size, (const char*)digest.h, sizeof(digest.h));
+
+	result = result && silk_append_file(db->path.data, batch.data, batch.size);
+	silk_dstr_clear(&db->pending);
+	silk_dstr_destroy(&batch);
+
+	silk_db_open(db, db->path.data);
+
+	/* Sorted again once the appended records take more room than the sorted ones */
+	if (result && db->size - db->tail_offset > db->tail_offset + SILK_DB_COMPACT_SLACK)
+	{
+		result = silk_db_compact(db);
+	}
+
+	return result;
 }
 
-SILK_API int
-silk_run(const char* executable_path)
+/* Get the last duration of the command creating 'name'. Returns false if it's unknown. */
+SILK_INTERNAL silk_bool
+silk_db_get_duration(const silk_db* db, const char* name, double* ms)
 {
-	return silk_process_in_directory(silk_tmp_sprintf("\"%s\"", executable_path), NULL);
+	silk_strv value;
+	silk_size tmp_index = silk_tmp_save();
+	silk_bool found = silk_db_get(db, silk_tmp_sprintf("ms %s", name), &value) && value.size == sizeof(double);
+	silk_tmp_restore(tmp_index);
+
+	if (found)
+	{
+		memcpy(ms, value.data, sizeof(double));
+	}
+	return found;
 }
 
-SILK_API const char*
-silk_process_stdout_string(silk_process_handle* handle)
+SILK_INTERNAL void
+silk_db_put_duration(silk_db* db, const char* name, double ms)
 {
-	return handle->stdout_string.data;
+	silk_size tmp_index = silk_tmp_save();
+	silk_db_put(db, silk_tmp_sprintf("ms %s", name), &ms, sizeof(double));
+	silk_tmp_restore(tmp_index);
 }
 
-SILK_API const char*
-silk_process_stderr_string(silk_process_handle* handle)
+/* Sum of the last durations of all the commands */
+SILK_INTERNAL double
+silk_db_total_duration(const silk_db* db)
 {
-	return handle->stderr_string.data;
+	silk_db_range range = silk_db_get_range(db, "ms ");
+	silk_strv key;
+	silk_strv value;
+	double ms = 0;
+	double total = 0;
+
+	while (silk_db_range_get_next(&range, &key, &value))
+	{
+		if (value.size == sizeof(double))
+		{
+			memcpy(&ms, value.data, sizeof(double));
+			total += ms;
+		}
+	}
+	return total;
 }
 
-SILK_API int
-silk_process_end(silk_process_handle* handle)
+/* Returns true if the command creating 'name' is the same as the last time it succeeded. */
+SILK_INTERNAL silk_bool
+silk_command_fingerprint_matches(const silk_db* db, const char* name, const char* cmd)
 {
-	silk_dstr_destroy(&handle->stdout_string);
-	silk_dstr_destroy(&handle->stderr_string);
+	silk_digest digest = silk_digest_make(cmd, strlen(cmd), 0);
+	silk_strv value;
+	silk_size tmp_index = silk_tmp_save();
+	silk_bool found = silk_db_get(db, silk_tmp_sprintf("cmd %s", name), &value);
+	silk_tmp_restore(tmp_index);
 
-	return handle->exit_code;
+	return found && value.size == sizeof(digest.h) && memcmp(value.data, digest.h, sizeof(digest.h)) == 0;
 }
 
-#if _WIN32
+/* Record the fingerprint of a command, any change of its flags, include directories, libraries, etc. changes it. */
+SILK_INTERNAL void
+silk_record_command_fingerprint(silk_db* db, const char* name, const char* cmd)
+{
+	silk_digest digest = silk_digest_make(cmd, strlen(cmd), 0);
+	silk_size tmp_index = silk_tmp_save();
+	silk_db_put(db, silk_tmp_sprintf("cmd %s", name), digest.h, sizeof(digest.h));
+	silk_tmp_restore(tmp_index);
+}
 
-/* #process */
+/*-----------------------------------------------------------------------*/
+/* silk_trace - commands run by the bakes, in the Chrome trace event format */
+/*-----------------------------------------------------------------------*/
 
-SILK_INTERNAL silk_process_handle*
-silk_process_core(silk_process_handle* handle)
-{
-	HANDLE process_stdout_write = NULL; /* Pipe (write) for stdout of the child process */
-	HANDLE process_stdout_read = NULL;  /* Pipe (read) for stdout of the child process */
-	HANDLE process_stderr_write = NULL; /* Pipe (write) for stderr of the child process */
-	HANDLE process_stderr_read = NULL;  /* Pipe (read) for stderr of the child process */
-	SECURITY_ATTRIBUTES saAttr;         /* To create the pipes. */
+typedef struct silk_trace_event silk_trace_event;
+struct silk_trace_event {
+	silk_size category; /* Offsets in silk_trace_strings, SILK_NPOS if there is none. */
+	silk_size name;
+	silk_size cmd;
+	silk_size output;
+	double start;       /* Milliseconds since the trace started */
+	double duration;
+	int exit_code;
+};
 
-	DWORD exit_code = (DWORD) -1;
-	DWORD wait_result = 0;
-	DWORD byte_read_from_buffer = 0;
-	char process_output_buffer[256] = { 0 };
-	BOOL handles_inheritance = 0;
+static char* silk_trace_path = NULL; /* The trace is disabled when NULL */
+static double silk_trace_origin = 0;
+static silk_darrT(silk_trace_event) silk_trace_events; /* Also used by the summary of the bakes */
+static silk_dstr silk_trace_strings;
+static silk_mutex silk_trace_mutex; /* Events are added by the workers */
+static silk_bool silk_summary_enabled = silk_true;
+static double silk_summary_process_time = 0;    /* Milliseconds spent in the processes since the bake started */
+static silk_size silk_summary_process_count = 0;
 
-	wchar_t* cmd_w = silk_utf8_to_utf16(handle->cmd);
-	wchar_t* starting_directory_w = NULL;
+SILK_API void
+silk_trace_file(const char* path)
+{
+	silk_size tmp_index = 0;
+	const char* absolute = NULL;
 
-	silk_log_debug("Running process '%s'", handle->cmd);
-	if (handle->starting_directory && handle->starting_directory[0])
+	silk_mutex_lock(&silk_trace_mutex);
+	if (silk_trace_path)
 	{
-		starting_directory_w = silk_utf8_to_utf16(handle->starting_directory);
-		silk_log_debug("Subprocess started in directory '%s'", handle->starting_directory);
+		SILK_FREE(silk_trace_path);
+		silk_trace_path = NULL;
 	}
 
-	/* Ensure that everything is written into the outputs before creating a new process that will also write in those outputs */
-	fflush(stdout);
-	fflush(stderr);
-
-	STARTUPINFOW si;
-	PROCESS_INFORMATION pi;
+	if (path)
+	{
+		tmp_index = silk_tmp_save();
+		absolute = silk_path_get_absolute_file(path);
+		silk_trace_path = (char*)SILK_MALLOC(strlen(absolute) + 1);
+		SILK_ASSERT(silk_trace_path);
+		strcpy(silk_trace_path, absolute);
+		silk_tmp_restore(tmp_index);
+
+		/* The trace starts now */
+		silk_trace_events.darr.size = 0;
+		silk_dstr_clear(&silk_trace_strings);
+		silk_trace_origin = silk_time_ms();
+	}
+	silk_mutex_unlock(&silk_trace_mutex);
+}
 
-	ZeroMemory(&si, sizeof(si));
-	si.silk = sizeof(si);
+SILK_INTERNAL void
+silk_trace_add(const char* category, const char* name, double start_time, const char* cmd, const char* output, int exit_code)
+{
+	silk_trace_event event;
+	double end_time = 0;
 
-	if (handle->stdout_to_string
-		|| handle->stderr_to_string)
+	if (!silk_trace_path && !silk_summary_enabled)
 	{
-		handles_inheritance = TRUE;
+		return;
+	}
 
-		si.hStdOutput = GetStdHandle(STD_OUTPUT_HANDLE);
-		si.hStdError = GetStdHandle(STD_ERROR_HANDLE);
-		si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+	end_time = silk_time_ms();
 
-		si.dwFlags |= STARTF_USESTDHANDLES;
-			
-		saAttr.nLength = sizeof(SECURITY_ATTRIBUTES);
-		saAttr.bInheritHandle = TRUE;
-		saAttr.lpSecurityDescriptor = NULL;
+	silk_mutex_lock(&silk_trace_mutex);
+	{
+		event.category = silk_dstr_push_str(&silk_trace_strings, category);
+		event.name = silk_dstr_push_str(&silk_trace_strings, name);
+		event.cmd = cmd ? silk_dstr_push_str(&silk_trace_strings, cmd) : SILK_NPOS;
+		event.output = output ? silk_dstr_push_str(&silk_trace_strings, output) : SILK_NPOS;
+		event.start = start_time - silk_trace_origin;
+		event.duration = end_time - start_time;
+		event.exit_code = exit_code;
+		silk_darrT_push_back(&silk_trace_events, event);
+	}
+	silk_mutex_unlock(&silk_trace_mutex);
+}
+
+/* Append the string between double quotes, escaped for JSON */
+SILK_INTERNAL void
+silk_dstr_append_json_string(silk_dstr* dstr, const char* str)
+{
+	silk_dstr_append_str(dstr, "\"");
+	for (; *str; ++str)
+	{
+		if (*str == '"' || *str == '\\')
+		{
+			silk_dstr_append_f(dstr, "\\%c", *str);
+		}
+		else if ((unsigned char)*str < 0x20)
+		{
+			silk_dstr_append_f(dstr, "\\u%04x", (unsigned int)(unsigned char)*str);
+		}
+		else
+		{
+			silk_dstr_append_from(dstr, dstr->size, str, 1);
+		}
+	}
+	silk_dstr_append_str(dstr, "\"");
+}
+
+SILK_INTERNAL const char*
+silk_json_skip_space(const char* cursor, const char* end)
+{
+	while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\n' || *cursor == '\r'))
+	{
+		cursor += 1;
+	}
+	return cursor;
+}
+
+/* Returns the end of the JSON value starting at 'cursor'. */
+SILK_INTERNAL const char*
+silk_json_skip_value(const char* cursor, const char* end)
+{
+	int depth = 0;
+
+	do
+	{
+		if (*cursor == '"')
+		{
+			for (cursor += 1; cursor < end && *cursor != '"'; cursor += (*cursor == '\\') ? 2 : 1)
+			{
+			}
+		}
+		else if (*cursor == '{' || *cursor == '[')
+		{
+			depth += 1;
+		}
+		else if (*cursor == '}' || *cursor == ']')
+		{
+			depth -= 1;
+		}
+		else if (depth == 0)
+		{
+			/* Number or literal */
+			while (cursor + 1 < end && strchr(",}] \t\r\n", cursor[1]) == NULL)
+			{
+				cursor += 1;
+			}
+		}
+		cursor += 1;
+	} while (cursor < end && depth > 0);
+
+	return cursor < end ? cursor : end;
+}
+
+/* Find the value of a member of the JSON object [object, end). The value keeps its quotes if it's a string. */
+SILK_INTERNAL silk_bool
+silk_json_get_member(const char* object, const char* end, const char* key, silk_strv* value)
+{
+	const char* cursor = silk_json_skip_space(object, end);
+	const char* name = NULL;
+	silk_size key_size = strlen(key);
+
+	if (cursor == end || *cursor != '{')
+	{
+		return silk_false;
+	}
+
+	for (cursor += 1; cursor < end; )
+	{
+		cursor = silk_json_skip_space(cursor, end);
+		if (cursor == end || *cursor != '"')
+		{
+			break;
+		}
+		name = cursor + 1;
+		cursor = silk_json_skip_value(cursor, end);
+		cursor = silk_json_skip_space(cursor, end);
+		if (cursor == end || *cursor != ':')
+		{
+			break;
+		}
+		cursor = silk_json_skip_space(cursor + 1, end);
+		value->data = cursor;
+		cursor = silk_json_skip_value(cursor, end);
+		value->size = cursor - value->data;
+
+		if ((silk_size)(cursor - name) > key_size + 1 && strncmp(name, key, key_size) == 0 && name[key_size] == '"')
+		{
+			return silk_true;
+		}
+		cursor = silk_json_skip_space(cursor, end);
+		if (cursor < end && *cursor == ',')
+		{
+			cursor += 1;
+		}
+	}
+	return silk_false;
+}
+
+/* Add the spans of the trace written by -ftime-trace (clang) inside the span of the compilation. */
+SILK_INTERNAL void
+silk_trace_append_time_trace(silk_dstr* json, const silk_trace_event* event, silk_size track, silk_dstr* content)
+{
+	const char* output = silk_trace_strings.data + event->output;
+	const char* dot = strrchr(output, '.');
+	const char* cursor = NULL;
+	const char* end = NULL;
+	const char* object = NULL;
+	silk_strv ph;
+	silk_strv ts;
+	silk_strv dur;
+	silk_strv name;
+	silk_strv args;
+	silk_strv detail;
+	double start = 0;
+	double duration = 0;
+	silk_size tmp_index = silk_tmp_save();
+
+	/* "x.o" gives "x.json" */
+	if (!dot || strchr(dot, '/') || strchr(dot, '\\')
+		|| !silk_read_file(silk_tmp_sprintf("%.*s.json", (int)(dot - output), output), content))
+	{
+		silk_tmp_restore(tmp_index);
+		return;
+	}
+	silk_tmp_restore(tmp_index);
+
+	end = content->data + content->size;
+	cursor = strstr(content->data, "\"traceEvents\"");
+	cursor = cursor ? strchr(cursor, '[') : NULL;
+	if (!cursor)
+	{
+		return;
+	}
+
+	for (cursor += 1; cursor < end; )
+	{
+		cursor = silk_json_skip_space(cursor, end);
+		if (cursor == end || *cursor != '{')
+		{
+			break;
+		}
+		object = cursor;
+		cursor = silk_json_skip_value(cursor, end);
+
+		/* Complete events, except the totals which start at 0 and cover all the events of a kind */
+		if (silk_json_get_member(object, cursor, "ph", &ph) && silk_strv_equals(ph, "\"X\"", 3)
+			&& silk_json_get_member(object, cursor, "ts", &ts)
+			&& silk_json_get_member(object, cursor, "dur", &dur)
+			&& silk_json_get_member(object, cursor, "name", &name)
+			&& strncmp(name.data, "\"Total ", 7) != 0)
+		{
+			start = strtod(ts.data, NULL) / 1000.0;
+			duration = strtod(dur.data, NULL) / 1000.0;
+			if (start < event->duration)
+			{
+				duration = start + duration > event->duration ? event->duration - start : duration;
+				silk_dstr_append_f(json, ",\n{\"name\":%.*s,\"cat\":\"time-trace\",\"ph\":\"X\",\"ts\":%.0f,\"dur\":%.0f,\"pid\":1,\"tid\":%d",
+					(int)name.size, name.data, (event->start + start) * 1000.0, duration * 1000.0, (int)track);
+				if (silk_json_get_member(object, cursor, "args", &args)
+					&& silk_json_get_member(args.data, args.data + args.size, "detail", &detail))
+				{
+					silk_dstr_append_f(json, ",\"args\":{\"detail\":%.*s}", (int)detail.size, detail.data);
+				}
+				silk_dstr_append_str(json, "}");
+			}
+		}
+
+		cursor = silk_json_skip_space(cursor, end);
+		if (cursor < end && *cursor == ',')
+		{
+			cursor += 1;
+		}
+	}
+}
+
+SILK_INTERNAL int
+silk_trace_event_compare(const void* left, const void* right)
+{
+	const silk_trace_event* l = (const silk_trace_event*)left;
+	const silk_trace_event* r = (const silk_trace_event*)right;
+	return l->start < r->start ? -1 : (l->start > r->start ? 1 : 0);
+}
+
+/* Write the trace file. Spans which don't overlap share a track, so there is about one track per worker. */
+SILK_INTERNAL void
+silk_trace_write(void)
+{
+	silk_dstr json;
+	silk_dstr content;
+	silk_darrT(double) track_ends; /* End of the last span of each track */
+	silk_trace_event* event = NULL;
+	silk_size track = 0;
+	silk_size i = 0;
+
+	if (!silk_trace_path)
+	{
+		return;
+	}
+
+	silk_dstr_init(&json);
+	silk_dstr_init(&content);
+	silk_darrT_init(&track_ends);
+
+	silk_mutex_lock(&silk_trace_mutex);
+
+	qsort(silk_trace_events.darr.data, silk_darrT_size(&silk_trace_events), sizeof(silk_trace_event), silk_trace_event_compare);
+
+	silk_dstr_append_str(&json, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"silk\"}}");
+	for (i = 0; i < silk_darrT_size(&silk_trace_events); ++i)
+	{
+		event = silk_darrT_ptr(&silk_trace_events, i);
+
+		for (track = 0; track < silk_darrT_size(&track_ends) && silk_darrT_at(&track_ends, track) > event->start; ++track)
+		{
+		}
+		if (track == silk_darrT_size(&track_ends))
+		{
+			silk_darrT_push_back(&track_ends, 0);
+			silk_dstr_append_f(&json, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"worker %d\"}}", (int)track + 1, (int)track + 1);
+		}
+		silk_darrT_at(&track_ends, track) = event->start + event->duration;
+
+		silk_dstr_append_str(&json, ",\n{\"name\":");
+		silk_dstr_append_json_string(&json, silk_trace_strings.data + event->name);
+		silk_dstr_append_str(&json, ",\"cat\":");
+		silk_dstr_append_json_string(&json, silk_trace_strings.data + event->category);
+		silk_dstr_append_f(&json, ",\"ph\":\"X\",\"ts\":%.0f,\"dur\":%.0f,\"pid\":1,\"tid\":%d,\"args\":{",
+			event->start * 1000.0, event->duration * 1000.0, (int)track + 1);
+		if (event->cmd != SILK_NPOS)
+		{
+			silk_dstr_append_str(&json, "\"command\":");
+			silk_dstr_append_json_string(&json, silk_trace_strings.data + event->cmd);
+			silk_dstr_append_str(&json, ",");
+		}
+		silk_dstr_append_f(&json, "\"exit_code\":%d}}", event->exit_code);
+
+		if (event->cmd != SILK_NPOS && event->output != SILK_NPOS && strstr(silk_trace_strings.data + event->cmd, "-ftime-trace"))
+		{
+			silk_trace_append_time_trace(&json, event, track + 1, &content);
+		}
+	}
+	silk_dstr_append_str(&json, "\n]}\n");
+
+	silk_write_file(silk_trace_path, json.data, json.size);
+
+	silk_mutex_unlock(&silk_trace_mutex);
+
+	silk_dstr_destroy(&json);
+	silk_dstr_destroy(&content);
+	silk_darrT_destroy(&track_ends);
+}
+
+/*-----------------------------------------------------------------------*/
+/* silk_summary - timing of a bake, printed at the end */
+/*-----------------------------------------------------------------------*/
+
+#ifndef SILK_SUMMARY_SLOWEST
+#define SILK_SUMMARY_SLOWEST 5 /* Number of slowest compilations shown */
+#endif
+
+typedef struct silk_summary silk_summary;
+struct silk_summary {
+	double start_time;
+	double cpu_time;         /* CPU time of the terminated children when the bake started, -1 if unknown. */
+	silk_size first_event;   /* First event of the bake in silk_trace_events */
+};
+
+SILK_API void
+silk_build_summary(silk_bool value)
+{
+	silk_summary_enabled = value;
+}
+
+/* CPU time (user and system) in milliseconds used by the terminated children, -1 if unknown. */
+SILK_INTERNAL double
+silk_children_cpu_time(void)
+{
+#ifdef _WIN32
+	return -1;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_CHILDREN, &usage) != 0)
+	{
+		return -1;
+	}
+	return (double)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0
+		+ (double)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+#endif
+}
+
+/* Called by silk_process_core for each process */
+SILK_INTERNAL void
+silk_summary_add_process(double duration)
+{
+	silk_mutex_lock(&silk_trace_mutex);
+	silk_summary_process_time += duration;
+	silk_summary_process_count += 1;
+	silk_mutex_unlock(&silk_trace_mutex);
+}
+
+SILK_INTERNAL void
+silk_summary_begin(silk_summary* summary)
+{
+	silk_mutex_lock(&silk_trace_mutex);
+	if (!silk_trace_path)
+	{
+		/* Events are only kept for the current bake */
+		silk_trace_events.darr.size = 0;
+		silk_dstr_clear(&silk_trace_strings);
+	}
+	silk_summary_process_time = 0;
+	silk_summary_process_count = 0;
+	summary->first_event = silk_darrT_size(&silk_trace_events);
+	silk_mutex_unlock(&silk_trace_mutex);
+
+	summary->start_time = silk_time_ms();
+	summary->cpu_time = silk_children_cpu_time();
+}
+
+SILK_INTERNAL int
+silk_summary_event_compare(const void* left, const void* right)
+{
+	const silk_trace_event* l = *(const silk_trace_event* const*)left;
+	const silk_trace_event* r = *(const silk_trace_event* const*)right;
+	return l->duration > r->duration ? -1 : (l->duration < r->duration ? 1 : 0);
+}
+
+SILK_INTERNAL void
+silk_summary_report(const silk_summary* summary)
+{
+	silk_darrT(silk_trace_event*) compilations;
+	silk_trace_event* event = NULL;
+	const char* category = NULL;
+	double wall_time = silk_time_ms() - summary->start_time;
+	double cpu_time = silk_children_cpu_time();
+	silk_bool has_links = silk_false;
+	silk_size i = 0;
+
+	if (!silk_summary_enabled || silk_summary_process_count == 0)
+	{
+		return; /* Nothing was run */
+	}
+
+	silk_darrT_init(&compilations);
+	silk_mutex_lock(&silk_trace_mutex);
+
+	if (summary->cpu_time >= 0 && cpu_time >= 0)
+	{
+		silk_log_important("Summary: %.2fs, %.2fs in %d command(s) (%.1fx parallelism), %.2fs CPU.",
+			wall_time / 1000.0, silk_summary_process_time / 1000.0, (int)silk_summary_process_count,
+			wall_time > 0 ? silk_summary_process_time / wall_time : 1.0, (cpu_time - summary->cpu_time) / 1000.0);
+	}
+	else
+	{
+		silk_log_important("Summary: %.2fs, %.2fs in %d command(s) (%.1fx parallelism).",
+			wall_time / 1000.0, silk_summary_process_time / 1000.0, (int)silk_summary_process_count,
+			wall_time > 0 ? silk_summary_process_time / wall_time : 1.0);
+	}
+
+	for (i = summary->first_event; i < silk_darrT_size(&silk_trace_events); ++i)
+	{
+		event = silk_darrT_ptr(&silk_trace_events, i);
+		if (strcmp(silk_trace_strings.data + event->category, "compile") == 0)
+		{
+			silk_darrT_push_back(&compilations, event);
+		}
+	}
+
+	if (silk_darrT_size(&compilations) > 0)
+	{
+		qsort(compilations.darr.data, silk_darrT_size(&compilations), sizeof(silk_trace_event*), silk_summary_event_compare);
+		silk_log_important("  Slowest compilations:");
+		for (i = 0; i < silk_darrT_size(&compilations) && i < SILK_SUMMARY_SLOWEST; ++i)
+		{
+			event = silk_darrT_at(&compilations, i);
+			silk_log_important("  %8.2fs  %s", event->duration / 1000.0, silk_trace_strings.data + event->name);
+		}
+	}
+
+	for (i = summary->first_event; i < silk_darrT_size(&silk_trace_events); ++i)
+	{
+		event = silk_darrT_ptr(&silk_trace_events, i);
+		category = silk_trace_strings.data + event->category;
+		if (strcmp(category, "link") == 0 || strcmp(category, "archive") == 0)
+		{
+			if (!has_links)
+			{
+				silk_log_important("  Links and archives:");
+				has_links = silk_true;
+			}
+			silk_log_important("  %8.2fs  %s", event->duration / 1000.0, silk_trace_strings.data + event->name);
+		}
+	}
+
+	silk_mutex_unlock(&silk_trace_mutex);
+	silk_darrT_destroy(&compilations);
+}
+
+/*-----------------------------------------------------------------------*/
+/* silk_compile_commands - compilation database (compile_commands.json) of the baked projects */
+/*-----------------------------------------------------------------------*/
+
+/* Each project writes its entries in its output directory, the database is the concatenation of them.
+   Not named .json, tools looking for a compilation database must not find a partial one. The name of the project
+   is given to the format, the projects sharing an output directory have their own fragment. */
+#define SILK_COMPILE_COMMANDS_FRAGMENT "compile_commands_%s.fragment"
+
+static char* silk_compile_commands_path = NULL;    /* No database is written when NULL */
+static silk_dstr silk_compile_commands_fragments;  /* Entries of the baked projects, null-terminated paths one after the other. */
+static silk_mutex silk_compile_commands_mutex;     /* Projects are baked concurrently by silk_bake_all */
+
+SILK_API void
+silk_compile_commands(const char* path)
+{
+	silk_size tmp_index = 0;
+	const char* absolute = NULL;
+
+	silk_mutex_lock(&silk_compile_commands_mutex);
+	if (silk_compile_commands_path)
+	{
+		SILK_FREE(silk_compile_commands_path);
+		silk_compile_commands_path = NULL;
+	}
+	silk_dstr_clear(&silk_compile_commands_fragments);
+
+	if (path)
+	{
+		tmp_index = silk_tmp_save();
+		absolute = silk_path_get_absolute_file(path);
+		silk_compile_commands_path = (char*)SILK_MALLOC(strlen(absolute) + 1);
+		SILK_ASSERT(silk_compile_commands_path);
+		strcpy(silk_compile_commands_path, absolute);
+		silk_tmp_restore(tmp_index);
+	}
+	silk_mutex_unlock(&silk_compile_commands_mutex);
+}
+
+SILK_INTERNAL silk_bool
+silk_compile_commands_enabled(void)
+{
+	silk_bool enabled = silk_false;
+	silk_mutex_lock(&silk_compile_commands_mutex);
+	enabled = silk_compile_commands_path != NULL;
+	silk_mutex_unlock(&silk_compile_commands_mutex);
+	return enabled;
+}
+
+/* Write the entries of a project, comma separated JSON objects. The file is only touched when the entries changed. */
+SILK_INTERNAL void
+silk_compile_commands_add(const char* fragment_path, const char* entries, silk_size size)
+{
+	silk_dstr buffer;
+	const char* cursor = NULL;
+	silk_bool found = silk_false;
+
+	silk_dstr_init(&buffer);
+	silk_write_file_if_changed(fragment_path, entries, size, &buffer);
+	silk_dstr_destroy(&buffer);
+
+	silk_mutex_lock(&silk_compile_commands_mutex);
+	for (cursor = silk_compile_commands_fragments.data;
+		!found && cursor < silk_compile_commands_fragments.data + silk_compile_commands_fragments.size;
+		cursor += strlen(cursor) + 1)
+	{
+		found = strcmp(cursor, fragment_path) == 0;
+	}
+	if (!found)
+	{
+		silk_dstr_push_str(&silk_compile_commands_fragments, fragment_path);
+	}
+	silk_mutex_unlock(&silk_compile_commands_mutex);
+}
+
+/* Write the database with the entries of all the projects baked since it was enabled.
+   Entries are not computed again, the fragments are read back, so it is cheap even for large trees. */
+SILK_INTERNAL void
+silk_compile_commands_write(void)
+{
+	silk_dstr json;
+	silk_dstr content;
+	const char* cursor = NULL;
+	silk_bool first = silk_true;
+
+	silk_mutex_lock(&silk_compile_commands_mutex);
+	if (!silk_compile_commands_path)
+	{
+		silk_mutex_unlock(&silk_compile_commands_mutex);
+		return;
+	}
+
+	silk_dstr_init(&json);
+	silk_dstr_init(&content);
+
+	silk_dstr_append_str(&json, "[\n");
+	for (cursor = silk_compile_commands_fragments.data;
+		cursor < silk_compile_commands_fragments.data + silk_compile_commands_fragments.size;
+		cursor += strlen(cursor) + 1)
+	{
+		if (silk_read_file(cursor, &content) && content.size > 0)
+		{
+			silk_dstr_append_str(&json, first ? "" : ",\n");
+			silk_dstr_append_from(&json, json.size, content.data, content.size);
+			first = silk_false;
+		}
+	}
+	silk_dstr_append_str(&json, "\n]\n");
+
+	/* Not touched when nothing changed, editors watching it don't reload it for nothing */
+	silk_write_file_if_changed(silk_compile_commands_path, json.data, json.size, &content);
+
+	silk_mutex_unlock(&silk_compile_commands_mutex);
+
+	silk_dstr_destroy(&json);
+	silk_dstr_destroy(&content);
+}
+
+/*-----------------------------------------------------------------------*/
+/* silk_plan - commands a bake would run, printed by the dry runs */
+/*-----------------------------------------------------------------------*/
+
+typedef struct silk_plan silk_plan;
+struct silk_plan {
+	silk_dstr steps;   /* One line per command */
+	silk_size count;
+	silk_size unknown; /* Commands never run before, they are not part of the expected duration. */
+	double expected;   /* Milliseconds spent in the commands the previous times */
+};
+
+static silk_bool silk_dry_run_enabled = silk_false;
+static silk_dstr silk_plan_artefacts; /* Artefacts the dry run would build, null-terminated strings one after the other. */
+static silk_mutex silk_plan_mutex;    /* Projects are planned concurrently by silk_bake_all */
+
+SILK_API void
+silk_dry_run(silk_bool value)
+{
+	silk_mutex_lock(&silk_plan_mutex);
+	silk_dry_run_enabled = value;
+	silk_dstr_clear(&silk_plan_artefacts);
+	silk_mutex_unlock(&silk_plan_mutex);
+}
+
+SILK_INTERNAL void
+silk_plan_init(silk_plan* plan)
+{
+	silk_dstr_init(&plan->steps);
+	plan->count = 0;
+	plan->unknown = 0;
+	plan->expected = 0;
+}
+
+SILK_INTERNAL void
+silk_plan_destroy(silk_plan* plan)
+{
+	silk_dstr_destroy(&plan->steps);
+}
+
+/* 'expected' is in milliseconds, negative when the command never ran. */
+SILK_INTERNAL void
+silk_plan_add(silk_plan* plan, const char* kind, const char* name, const char* reason, double expected)
+{
+	if (expected < 0)
+	{
+		silk_dstr_append_f(&plan->steps, "\n  %-10s        ?  %s: %s", kind, name, reason);
+		plan->unknown += 1;
+	}
+	else
+	{
+		silk_dstr_append_f(&plan->steps, "\n  %-10s %8.2fs  %s: %s", kind, expected / 1000.0, name, reason);
+		plan->expected += expected;
+	}
+	plan->count += 1;
+}
+
+/* Projects linking the artefact are planned after it, they are linked again too. */
+SILK_INTERNAL void
+silk_plan_rebuild(const char* artefact)
+{
+	silk_mutex_lock(&silk_plan_mutex);
+	silk_dstr_push_str(&silk_plan_artefacts, artefact);
+	silk_mutex_unlock(&silk_plan_mutex);
+}
+
+SILK_INTERNAL silk_bool
+silk_plan_is_rebuilt(const char* artefact)
+{
+	const char* cursor = NULL;
+	silk_bool found = silk_false;
+
+	silk_mutex_lock(&silk_plan_mutex);
+	for (cursor = silk_plan_artefacts.data; !found && cursor < silk_plan_artefacts.data + silk_plan_artefacts.size; cursor += strlen(cursor) + 1)
+	{
+		found = strcmp(cursor, artefact) == 0;
+	}
+	silk_mutex_unlock(&silk_plan_mutex);
+	return found;
+}
+
+/* The whole plan of a project is printed at once, projects baked concurrently don't mix their lines.
+   It does not go through the temporary allocator, the plans of large projects are big. */
+SILK_INTERNAL void
+silk_plan_report(const silk_plan* plan, const char* project_name)
+{
+	silk_dstr text;
+
+	if (plan->count == 0)
+	{
+		silk_log_important("Plan for '%s': up to date", project_name);
+		return;
+	}
+
+	silk_dstr_init(&text);
+	silk_dstr_append_f(&text, "Plan for '%s': %d command(s), %.2fs expected", project_name, (int)plan->count, plan->expected / 1000.0);
+	if (plan->unknown > 0)
+	{
+		silk_dstr_append_f(&text, " plus %d never run", (int)plan->unknown);
+	}
+	silk_dstr_append_from(&text, text.size, plan->steps.data, plan->steps.size);
+	silk_dstr_append_str(&text, "\n");
+	fwrite(text.data, 1, text.size, stdout);
+	silk_dstr_destroy(&text);
+}
+
+/*-----------------------------------------------------------------------*/
+/* silk_cache - objects shared between builds, found by the digest of what produced them */
+/*-----------------------------------------------------------------------*/
+
+static char* silk_cache_dir = NULL;                               /* The cache is disabled when NULL */
+static silk_size silk_cache_max = (silk_size)1024 * 1024 * 1024;  /* 1 GiB */
+static silk_size silk_cache_hits = 0;
+static silk_size silk_cache_misses = 0;
+static silk_size silk_cache_tmp_count = 0; /* Makes the name of the files being stored unique */
+static silk_mutex silk_cache_mutex;        /* Objects are fetched and stored by the workers */
+
+SILK_API void
+silk_cache_directory(const char* directory)
+{
+	silk_size tmp_index = 0;
+	const char* absolute = NULL;
+
+	if (silk_cache_dir)
+	{
+		SILK_FREE(silk_cache_dir);
+		silk_cache_dir = NULL;
+	}
+
+	if (directory)
+	{
+		/* The temporary buffer is reset by silk_clear, the path is kept until silk_cache_directory is called again */
+		tmp_index = silk_tmp_save();
+		absolute = silk_path_get_absolute_dir(directory);
+		silk_cache_dir = (char*)SILK_MALLOC(strlen(absolute) + 1);
+		SILK_ASSERT(silk_cache_dir);
+		strcpy(silk_cache_dir, absolute);
+		silk_tmp_restore(tmp_index);
+	}
+}
+
+SILK_API void
+silk_cache_max_size(silk_size size)
+{
+	silk_cache_max = size;
+}
+
+/* Objects are spread in 256 directories named after the first two characters of their key */
+SILK_INTERNAL const char*
+silk_cache_object_path(const char* key)
+{
+	return silk_tmp_sprintf("%s%.2s/%s.o", silk_cache_dir, key, key + 2);
+}
+
+/* Copy the object cached with 'key' to 'object'. Returns false if the cache does not contain it. */
+SILK_INTERNAL silk_bool
+silk_cache_fetch(const char* key, const char* object)
+{
+	const char* cached = silk_cache_object_path(key);
+	double mtime = 0;
+	silk_bool hit = silk_file_mtime(cached, &mtime) && silk_copy_file(cached, object);
+
+#ifndef _WIN32
+	if (hit)
+	{
+		/* The modification time tells which objects were used recently when the cache is trimmed */
+		utime(cached, NULL);
+	}
+#endif
+
+	silk_mutex_lock(&silk_cache_mutex);
+	if (hit)
+	{
+		silk_cache_hits += 1;
+	}
+	else
+	{
+		silk_cache_misses += 1;
+	}
+	silk_mutex_unlock(&silk_cache_mutex);
+
+	return hit;
+}
+
+/* Store 'object' in the cache with 'key'. */
+SILK_INTERNAL void
+silk_cache_store(const char* key, const char* object)
+{
+	const char* cached = silk_cache_object_path(key);
+	const char* partial = NULL;
+	silk_size count = 0;
+
+	silk_mutex_lock(&silk_cache_mutex);
+	count = silk_cache_tmp_count++;
+	silk_mutex_unlock(&silk_cache_mutex);
+
+	/* The object is copied under another name first, builds sharing the cache never see a partial object. */
+#ifdef _WIN32
+	partial = silk_tmp_sprintf("%s.%d.%d.tmp", cached, (int)GetCurrentProcessId(), (int)count);
+#else
+	partial = silk_tmp_sprintf("%s.%d.%d.tmp", cached, (int)getpid(), (int)count);
+#endif
+
+	if (!silk_copy_file(object, partial) || rename(partial, cached) != 0)
+	{
+		silk_log_debug("Could not store '%s' in the cache.", object);
+		remove(partial);
+	}
+}
+
+typedef struct silk_cache_file silk_cache_file;
+struct silk_cache_file {
+	double mtime;
+	silk_size size;
+	silk_size path; /* Offset of the path in the list of paths */
+};
+
+SILK_INTERNAL int
+silk_cache_file_compare(const void* left, const void* right)
+{
+	double l = ((const silk_cache_file*)left)->mtime;
+	double r = ((const silk_cache_file*)right)->mtime;
+	return l < r ? -1 : (l > r ? 1 : 0);
+}
+
+/* Remove the least recently used objects until the cache uses less than 90% of its maximum size. */
+SILK_INTERNAL void
+silk_cache_trim(void)
+{
+#ifndef _WIN32
+	silk_darrT(silk_cache_file) files;
+	silk_cache_file file;
+	silk_dstr paths;
+	DIR* dir = NULL;
+	DIR* subdir = NULL;
+	struct dirent* entry = NULL;
+	struct dirent* subentry = NULL;
+	struct stat st;
+	const char* subdir_path = NULL;
+	const char* path = NULL;
+	silk_size total_size = 0;
+	silk_size tmp_index = 0;
+	silk_size subdir_tmp_index = 0;
+	silk_size i = 0;
+
+	dir = opendir(silk_cache_dir);
+	if (!dir)
+	{
+		return;
+	}
+
+	silk_darrT_init(&files);
+	silk_dstr_init(&paths);
+
+	while ((entry = readdir(dir)) != NULL)
+	{
+		if (entry->d_name[0] == '.')
+		{
+			continue;
+		}
+
+		subdir_tmp_index = silk_tmp_save();
+		subdir_path = silk_tmp_sprintf("%s%s/", silk_cache_dir, entry->d_name);
+		subdir = opendir(subdir_path);
+		while (subdir && (subentry = readdir(subdir)) != NULL)
+		{
+			tmp_index = silk_tmp_save();
+			path = silk_tmp_sprintf("%s%s", subdir_path, subentry->d_name);
+			if (subentry->d_name[0] != '.' && stat(path, &st) == 0 && S_ISREG(st.st_mode))
+			{
+				file.mtime = (double)st.st_mtime;
+				file.size = (silk_size)st.st_size;
+				file.path = silk_dstr_push_str(&paths, path);
+				silk_darrT_push_back(&files, file);
+				total_size += file.size;
+			}
+			silk_tmp_restore(tmp_index);
+		}
+		if (subdir)
+		{
+			closedir(subdir);
+		}
+		silk_tmp_restore(subdir_tmp_index);
+	}
+	closedir(dir);
+
+	if (total_size > silk_cache_max)
+	{
+		qsort(files.darr.data, silk_darrT_size(&files), sizeof(silk_cache_file), silk_cache_file_compare);
+
+		for (i = 0; i < silk_darrT_size(&files) && total_size > silk_cache_max / 10 * 9; ++i)
+		{
+			file = silk_darrT_at(&files, i);
+			if (remove(paths.data + file.path) == 0)
+			{
+				total_size -= file.size;
+			}
+		}
+		silk_log_debug("Cache trimmed, %d object(s) removed.", (int)i);
+	}
+
+	silk_darrT_destroy(&files);
+	silk_dstr_destroy(&paths);
+#endif
+}
+
+/* Print how many objects were taken from the cache since the last report, the cache is trimmed if some were added. */
+SILK_INTERNAL void
+silk_cache_report(void)
+{
+	if (!silk_cache_dir || silk_cache_hits + silk_cache_misses == 0)
+	{
+		return;
+	}
+
+	silk_log_important("Cache: %d hit(s), %d miss(es).", (int)silk_cache_hits, (int)silk_cache_misses);
+
+	if (silk_cache_misses > 0)
+	{
+		silk_cache_trim();
+	}
+
+	silk_cache_hits = 0;
+	silk_cache_misses = 0;
+}
+
+/*-----------------------------------------------------------------------*/
+/* silk_jobserver - share the job slots with make and with nested builds */
+/*-----------------------------------------------------------------------*/
+
+/* A jobserver is a pipe (or a named pipe) containing one byte per command that can be started, in addition
+   to the one every process can run without a token. See "POSIX Jobserver Interaction" in the GNU make manual. */
+static silk_bool silk_jobserver_ready = silk_false; /* silk_jobserver_setup has been called */
+static int silk_jobserver_read_fd = -1;
+static int silk_jobserver_write_fd = -1;
+static int silk_jobserver_token_fd = -1; /* Non-blocking read end, tokens are read from it when it's available */
+static silk_mutex silk_jobserver_mutex; /* Only one thread waits for a token at a time */
+#ifndef _WIN32
+extern char** environ;
+static char* silk_jobserver_makeflags = NULL; /* "MAKEFLAGS=..." of the commands, when silk is the jobserver */
+#endif
+
+SILK_INTERNAL silk_bool
+silk_jobserver_is_used(void)
+{
+	return silk_jobserver_read_fd != -1;
+}
+
+#ifndef _WIN32
+/* Read end of the pipe which does not block. O_NONBLOCK can't be set on 'fd', the open file description is shared
+   with make and the other clients, so the pipe is opened again through /proc (Linux). Returns -1 if it can't. */
+SILK_INTERNAL int
+silk_jobserver_open_nonblocking(int fd)
+{
+	int result = open(silk_tmp_sprintf("/proc/self/fd/%d", fd), O_RDONLY | O_NONBLOCK);
+	if (result != -1)
+	{
+		fcntl(result, F_SETFD, FD_CLOEXEC);
+	}
+	return result;
+}
+
+/* Use the jobserver described in MAKEFLAGS, "--jobserver-auth=fifo:PATH" or "--jobserver-auth=R,W" (older make use --jobserver-fds). */
+SILK_INTERNAL silk_bool
+silk_jobserver_connect(const char* makeflags)
+{
+	const char* options[] = { "--jobserver-auth=", "--jobserver-fds=" };
+	const char* auth = NULL;
+	const char* found = NULL;
+	const char* end = NULL;
+	const char* path = NULL;
+	silk_size i = 0;
+	int read_fd = -1;
+	int write_fd = -1;
+
+	/* The last one is used if there are several */
+	for (i = 0; i < sizeof(options) / sizeof(options[0]); ++i)
+	{
+		for (found = strstr(makeflags, options[i]); found != NULL; found = strstr(found + 1, options[i]))
+		{
+			if (auth == NULL || found > auth)
+			{
+				auth = found + strlen(options[i]);
+			}
+		}
+	}
+
+	if (auth == NULL)
+	{
+		return silk_false;
+	}
+
+	for (end = auth; *end != '\0' && *end != ' '; ++end) {}
+
+	if (strncmp(auth, "fifo:", 5) == 0)
+	{
+		path = silk_tmp_strv_to_str(silk_strv_make(auth + 5, end - auth - 5));
+		read_fd = open(path, O_RDWR | O_NONBLOCK); /* Only silk uses this open file description */
+		if (read_fd == -1)
+		{
+			silk_log_warning("Could not open jobserver '%s': %s", path, strerror(errno));
+			return silk_false;
+		}
+		fcntl(read_fd, F_SETFD, FD_CLOEXEC); /* The children find the path in MAKEFLAGS */
+		write_fd = read_fd;
+	}
+	else if (sscanf(auth, "%d,%d", &read_fd, &write_fd) != 2
+		|| read_fd < 0 || write_fd < 0)
+	{
+		silk_log_warning("Unsupported jobserver '%.*s'.", (int)(end - auth), auth);
+		return silk_false;
+	}
+	else if (fcntl(read_fd, F_GETFD) == -1 || fcntl(write_fd, F_GETFD) == -1)
+	{
+		/* make closes them when it does not know that the command is a build, the rule should start with '+' */
+		silk_log_warning("Jobserver file descriptors are not available, mark the make rule with '+' to share the job slots.");
+		return silk_false;
+	}
+
+	silk_jobserver_read_fd = read_fd;
+	silk_jobserver_write_fd = write_fd;
+	silk_jobserver_token_fd = read_fd == write_fd ? read_fd : silk_jobserver_open_nonblocking(read_fd);
+	silk_log_debug("Using jobserver '%.*s'", (int)(end - auth), auth);
+	return silk_true;
+}
+
+/* Create a jobserver for the commands run by silk and tell them with MAKEFLAGS. */
+SILK_INTERNAL void
+silk_jobserver_create(void)
+{
+	silk_size count = silk_get_job_count();
+	silk_size i = 0;
+	int pfd[2] = { -1, -1 };
+	const char* makeflags = NULL;
+
+	if (pipe(pfd) == -1)
+	{
+		silk_log_warning("Could not create the jobserver: %s", strerror(errno));
+		return;
+	}
+
+	/* This process holds one token */
+	for (i = 1; i < count; ++i)
+	{
+		if (write(pfd[1], "+", 1) != 1)
+		{
+			silk_log_warning("Could not create the jobserver: %s", strerror(errno));
+			close(pfd[0]);
+			close(pfd[1]);
+			return;
+		}
+	}
+
+	/* MAKEFLAGS of the commands, see silk_jobserver_environment. The environment of silk is left as is.
+	   The jobserver fds are inherited, they are not close-on-exec. */
+	makeflags = getenv("MAKEFLAGS");
+	makeflags = silk_tmp_sprintf("MAKEFLAGS=%s -j%d --jobserver-auth=%d,%d", makeflags ? makeflags : "", (int)count, pfd[0], pfd[1]);
+	silk_jobserver_makeflags = (char*)SILK_MALLOC(strlen(makeflags) + 1);
+	strcpy(silk_jobserver_makeflags, makeflags);
+
+	silk_jobserver_read_fd = pfd[0];
+	silk_jobserver_write_fd = pfd[1];
+	silk_jobserver_token_fd = silk_jobserver_open_nonblocking(pfd[0]);
+	silk_log_debug("Jobserver created with %d token(s)", (int)count - 1);
+}
+
+/* Environment of a command: 'env' when given, otherwise the environment of silk with the MAKEFLAGS of the jobserver it created.
+   Built for each command, so the variables set by the silkfile between two commands are seen. */
+SILK_INTERNAL char**
+silk_jobserver_environment(const char* const* env)
+{
+	char** result = NULL;
+	silk_size env_count = 0;
+	silk_size i = 0;
+
+	if (env != NULL || silk_jobserver_makeflags == NULL)
+	{
+		return env ? (char**)env : environ;
+	}
+
+	while (environ[env_count] != NULL)
+	{
+		env_count += 1;
+	}
+
+	result = (char**)silk_tmp_alloc((env_count + 2) * sizeof(char*));
+	result[0] = silk_jobserver_makeflags;
+	env_count = 1;
+	for (i = 0; environ[i] != NULL; ++i)
+	{
+		if (strncmp(environ[i], "MAKEFLAGS=", 10) != 0)
+		{
+			result[env_count] = environ[i];
+			env_count += 1;
+		}
+	}
+	result[env_count] = NULL;
+
+	return result;
+}
+#endif
+
+/* Connect to the jobserver of make, or create one. Only done once, before the first command is run. */
+SILK_INTERNAL void
+silk_jobserver_setup(void)
+{
+	const char* makeflags = NULL;
+
+	silk_mutex_lock(&silk_job_mutex);
+	if (!silk_jobserver_ready)
+	{
+		silk_jobserver_ready = silk_true;
+#ifndef _WIN32
+		makeflags = getenv("MAKEFLAGS");
+		if (makeflags == NULL || !silk_jobserver_connect(makeflags))
+		{
+			silk_jobserver_create();
+		}
+#else
+		makeflags = getenv("MAKEFLAGS");
+		if (makeflags != NULL && strstr(makeflags, "--jobserver-auth=") != NULL)
+		{
+			silk_log_warning("The jobserver of make is not supported on Windows, silk runs up to %d command(s) on its own.", (int)silk_get_job_count());
+		}
+#endif
+	}
+	silk_mutex_unlock(&silk_job_mutex);
+}
+
+/* Wait a bit for a token, returns true if one was taken. */
+SILK_INTERNAL silk_bool
+silk_jobserver_wait_token(void)
+{
+	silk_bool has_token = silk_false;
+#ifndef _WIN32
+	struct pollfd pfd;
+	char token = 0;
+	ssize_t result = 0;
+	int fd = -1;
+
+	silk_mutex_lock(&silk_jobserver_mutex);
+
+	/* Another process can take the token first, the non-blocking read then returns EAGAIN and the caller
+	   can still use a slot freed in the meantime. Without one (no /proc), read waits until a token is returned. */
+	fd = silk_jobserver_token_fd != -1 ? silk_jobserver_token_fd : silk_jobserver_read_fd;
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	if (poll(&pfd, 1, 100) > 0)
+	{
+		result = read(fd, &token, 1);
+		if (result == 1)
+		{
+			has_token = silk_true;
+		}
+		else if (result == 0 || (errno != EINTR && errno != EAGAIN))
+		{
+			silk_log_warning("Jobserver is not available anymore, job slots are not shared.");
+			if (silk_jobserver_token_fd != -1 && silk_jobserver_token_fd != silk_jobserver_read_fd)
+			{
+				close(silk_jobserver_token_fd);
+			}
+			silk_jobserver_read_fd = -1;
+			silk_jobserver_token_fd = -1;
+		}
+	}
+
+	silk_mutex_unlock(&silk_jobserver_mutex);
+#endif
+	return has_token;
+}
+
+SILK_INTERNAL void
+silk_jobserver_return_token(void)
+{
+#ifndef _WIN32
+	if (write(silk_jobserver_write_fd, "+", 1) != 1)
+	{
+		silk_log_warning("Could not return a token to the jobserver: %s", strerror(errno));
+	}
+#endif
+}
+
+SILK_INTERNAL void
+silk_jobserver_destroy(void)
+{
+#ifndef _WIN32
+	if (silk_jobserver_token_fd != -1 && silk_jobserver_token_fd != silk_jobserver_read_fd)
+	{
+		close(silk_jobserver_token_fd);
+	}
+	if (silk_jobserver_makeflags)
+	{
+		/* Close the jobserver created by silk */
+		SILK_FREE(silk_jobserver_makeflags);
+		silk_jobserver_makeflags = NULL;
+		close(silk_jobserver_read_fd);
+		close(silk_jobserver_write_fd);
+	}
+	else if (silk_jobserver_read_fd != -1 && silk_jobserver_read_fd == silk_jobserver_write_fd)
+	{
+		close(silk_jobserver_read_fd); /* Named pipe opened by silk */
+	}
+#endif
+	silk_jobserver_read_fd = -1;
+	silk_jobserver_write_fd = -1;
+	silk_jobserver_token_fd = -1;
+	silk_jobserver_ready = silk_false;
+}
+
+SILK_API void
+silk_init(void)
+{
+	silk_context_init(&default_ctx);
+	current_ctx = &default_ctx;
+	silk_mutex_init(&silk_cache_mutex);
+	silk_mutex_init(&silk_job_mutex);
+	silk_cond_init(&silk_job_cond);
+	silk_dstr_init(&silk_pch_claimed);
+	silk_cond_init(&silk_pch_cond);
+	silk_mutex_init(&silk_shared_mutex);
+	silk_mutex_init(&silk_jobserver_mutex);
+	silk_mutex_init(&silk_trace_mutex);
+	silk_darrT_init(&silk_trace_events);
+	silk_dstr_init(&silk_trace_strings);
+	silk_mutex_init(&silk_compile_commands_mutex);
+	silk_dstr_init(&silk_compile_commands_fragments);
+	silk_mutex_init(&silk_plan_mutex);
+	silk_dstr_init(&silk_plan_artefacts);
+#ifdef _WIN32
+	silk_bool exit_on_exception = silk_true; /* @TODO make this configurable */
+	if (exit_on_exception)
+	{
+		SetUnhandledExceptionFilter(exit_on_exception_handler);
+	}
+#endif
+}
+
+SILK_API void
+silk_destroy(void)
+{
+	silk_context_destroy(silk_current_context());
+	silk_tmp_reset();
+	silk_cache_directory(NULL);
+	silk_mutex_destroy(&silk_cache_mutex);
+	silk_mutex_destroy(&silk_job_mutex);
+	silk_cond_destroy(&silk_job_cond);
+	silk_mutex_destroy(&silk_shared_mutex);
+	silk_dstr_destroy(&silk_pch_claimed);
+	silk_cond_destroy(&silk_pch_cond);
+	silk_jobserver_destroy();
+	silk_mutex_destroy(&silk_jobserver_mutex);
+	silk_trace_file(NULL);
+	silk_darrT_destroy(&silk_trace_events);
+	silk_dstr_destroy(&silk_trace_strings);
+	silk_mutex_destroy(&silk_trace_mutex);
+	silk_compile_commands(NULL);
+	silk_dstr_destroy(&silk_compile_commands_fragments);
+	silk_mutex_destroy(&silk_compile_commands_mutex);
+	silk_dstr_destroy(&silk_plan_artefacts);
+	silk_mutex_destroy(&silk_plan_mutex);
+}
+
+SILK_API void
+silk_clear(void)
+{
+	silk_context_clear(silk_current_context());
+	silk_tmp_reset();
+}
+
+SILK_API silk_project_t*
+silk_project(const char* name)
+{
+	silk_project_t* project;
+
+	if (!silk_try_find_project_by_name_str(name, &project))
+	{
+		project = silk_create_project(name);
+	}
+
+	silk_current_context()->current_project = project;
+	return project;
+}
+
+SILK_API silk_project_t*
+silk_project_f(const char* format, ...)
+{
+	silk_project_t* p;
+	va_list args;
+	va_start(args, format);
+
+	p = silk_project(silk_tmp_vsprintf(format, args));
+
+	va_end(args);
+
+	return p;
+}
+
+SILK_API void
+silk_add_many_core(silk_strv key, silk_strv values[], silk_size count)
+{
+	silk_size i;
+	silk_strv value = { 0 };
+	/* Check that the ptr is contains in the tmp buffer */
+	SILK_ASSERT(silk_tmp_contains(key.data));
+
+	for (i = 0; i < count; ++i)
+	{
+		value = values[i];
+		/* Check that the ptr is contains in the tmp buffer */
+		SILK_ASSERT(silk_tmp_contains(value.data));
+		
+		silk_mmap_insert(
+			&silk_current_project()->mmap,
+			silk_kv_make_with_strv(key, value));
+	}
+}
+
+SILK_INTERNAL void
+silk_add_many(const char* key, const char* values[], silk_size count)
+{
+	silk_size i;
+	silk_strv value = { 0 };
+
+	for (i = 0; i < count; ++i)
+	{
+		value = silk_tmp_str_to_strv(values[i]);
+		silk_add_many_core(silk_tmp_str_to_strv(key), &value, 1);
+	}
+}
+
+SILK_API void
+silk_add_many_vnull(const char* key, ...)
+{
+	silk_strv value;
+	va_list args;
+	const char* current = NULL;
+	va_start(args, key);
+
+	current = va_arg(args, const char*);
+	SILK_ASSERT(current);
+	while (current)
+	{
+		value = silk_tmp_str_to_strv(current);
+		silk_add_many_core(silk_tmp_str_to_strv(key), &value, 1);
+		current = va_arg(args, const char*);
+	}
+	va_end(args);
+}
+
+SILK_API void
+silk_add(const char* key, const char* value)
+{
+	silk_strv value_copy = silk_tmp_str_to_strv(value);
+	silk_add_many_core(silk_tmp_str_to_strv(key), &value_copy, 1);
+}
+
+SILK_API void
+silk_add_f(const char* key, const char* format, ...)
+{
+	silk_strv value;
+	va_list args;
+	va_start(args, format);
+
+	value = silk_tmp_strv_vprintf(format, args);
+	silk_add_many_core(silk_tmp_str_to_strv(key), &value, 1);
+
+	va_end(args);
+}
+
+SILK_API void
+silk_set(const char* key, const char* value)
+{
+	/* @OPT this can easily be optimized, but we don't care about that right now. */
+	silk_remove_all(key);
+	silk_add(key, value);
+}
+
+SILK_API void
+silk_set_f(const char* key, const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+
+	silk_set(key, silk_tmp_vsprintf(format, args));
+
+	va_end(args);
+}
+
+SILK_API silk_size
+silk_remove_all(const char* key)
+{
+	silk_kv kv = silk_kv_make_with_str(silk_strv_make_str(key), "");
+	silk_project_t* p = silk_current_project();
+	return silk_mmap_remove(&p->mmap, kv);
+}
+
+SILK_API silk_size
+silk_remove_all_f(const char* format, ...)
+{
+	va_list args;
+	silk_size count = 0;
+	va_start(args, format);
+
+	count = silk_remove_all(silk_tmp_vsprintf(format, args));
+
+	va_end(args);
+	return count;
+}
+
+SILK_API silk_bool
+silk_contains(const char* key, const char* value)
+{
+	silk_project_t* p;
+	silk_kv_range range;
+	silk_kv kv = silk_kv_make_with_str(silk_strv_make_str(key), value);
+	p = silk_current_project();
+	range = silk_mmap_get_range(&p->mmap, kv.key);
+
+	while (range.begin < range.end)
+	{
+		if (silk_strv_equals_strv((*range.begin).u.strv, kv.u.strv))
+		{
+			return silk_true;
+		}
+		range.begin++;
+	}
+	return silk_false;
+}
+
+SILK_API silk_bool
+silk_remove_one(const char* key, const char* value)
+{
+	silk_kv kv = silk_kv_make_with_str(silk_strv_make_str(key), value);
+	silk_project_t* p = silk_current_project();
+	silk_kv_range range = silk_mmap_get_range(&p->mmap, kv.key);
+
+	while (range.begin < range.end)
+	{
+		if (silk_strv_equals_strv((*range.begin).u.strv, kv.u.strv))
+		{
+			silk_size index = p->mmap.darr.data - range.begin;
+			silk_darrT_remove(&p->mmap, index);
+			return silk_true;
+		}
+		range.begin++;
+	}
+	return silk_false;
+}
+
+SILK_API silk_bool
+silk_remove_one_f(const char* key, const char* format, ...)
+{
+	va_list args;
+	silk_bool was_removed = silk_false;
+	va_start(args, format);
+
+	was_removed = silk_remove_one(key, silk_tmp_vsprintf(format, args));
+
+	va_end(args);
+	return was_removed;
+}
+
+SILK_API void
+silk_add_file(const char* file)
+{
+	silk_add(silk_FILES, file);
+}
+
+/* Properties are just (strv) values from the map of a project. */
+SILK_INTERNAL silk_bool
+try_get_property(silk_project_t* project, const char* key, silk_kv* result)
+{
+	if (silk_mmap_try_get_first(&project->mmap, silk_strv_make_str(key), result))
+	{
+		return silk_true;
+	}
+	return silk_false;
+}
+
+SILK_INTERNAL silk_bool
+try_get_property_strv(silk_project_t* project, const char* key, silk_strv* result)
+{
+	silk_kv kv_result;
+	if (silk_mmap_try_get_first(&project->mmap, silk_strv_make_str(key), &kv_result))
+	{
+		*result = kv_result.u.strv;
+		return silk_true;
+	}
+	return silk_false;
+}
+
+SILK_INTERNAL silk_bool
+silk_property_equals(silk_project_t* project, const char* key, const char* comparison_value)
+{
+	silk_strv result;
+	return try_get_property_strv(project, key, &result)
+		&& silk_strv_equals_str(result, comparison_value);
+}
+
+SILK_API const char*
+silk_bake_project_with(silk_toolchain toolchain, const char* project_name)
+{
+	const char* result = NULL;
+	silk_summary summary;
+
+	silk_summary_begin(&summary);
+	result = toolchain.bake(&toolchain, project_name);
+	silk_log_important("%s", result);
+	silk_cache_report();
+	silk_summary_report(&summary);
+	silk_trace_write();
+	if (!silk_dry_run_enabled)
+	{
+		silk_compile_commands_write();
+	}
+	return result;
+}
+
+SILK_API const char*
+silk_bake_project(const char* project_name)
+{
+	return silk_bake_project_with(silk_toolchain_default(), project_name);
+}
+
+SILK_API const char*
+silk_bake(void)
+{
+	silk_project_t* p = silk_current_project();
+	return silk_bake_project(p->name.data);
+}
+
+SILK_INTERNAL const char*
+silk_get_output_directory(silk_project_t* project, const silk_toolchain* tc)
+{
+	silk_strv out_dir;
+	if (try_get_property_strv(project, silk_OUTPUT_DIR, &out_dir))
+	{
+		return silk_path_get_absolute_dir(out_dir.data);
+	}
+	else
+	{
+		/* Get default output directory */
+		return silk_path_get_absolute_dir(silk_path_combine(tc->default_directory_base, project->name.data));
+	}
+}
+
+/*-----------------------------------------------------------------------*/
+/* silk_bake_all - bake projects in the order of their links */
+/*-----------------------------------------------------------------------*/
+
+typedef struct silk_bake_node silk_bake_node;
+struct silk_bake_node {
+	silk_project_t* project;
+	silk_darrT(silk_size) dependents; /* Projects linking this one */
+	silk_size pending;                /* Linked projects not baked yet */
+	double critical_path;             /* Milliseconds spent in the commands of this project and of the longest chain of projects linking it, the last time */
+};
+
+typedef struct silk_bake_graph silk_bake_graph;
+struct silk_bake_graph {
+	silk_toolchain toolchain;
+	silk_bake_node* nodes;
+	silk_size count;
+	silk_darrT(silk_size) ready; /* Projects whose linked projects are all baked */
+	silk_size remaining;         /* Projects not baked yet */
+	silk_bool failed;            /* No new project is baked once one of them failed. */
+	silk_mutex mutex;
+	silk_cond cond;
+};
+
+SILK_INTERNAL silk_size
+silk_bake_graph_find(silk_bake_graph* graph, silk_strv name)
+{
+	silk_size i = 0;
+	for (i = 0; i < graph->count; ++i)
+	{
+		if (silk_strv_equals(graph->nodes[i].project->name, name.data, name.size))
+		{
+			return i;
+		}
+	}
+	return SILK_NPOS;
+}
+
+/* Log the projects linking each other. Called when some projects are never ready, starting from one of them. */
+SILK_INTERNAL void
+silk_bake_graph_log_cycle(silk_bake_graph* graph, silk_size start)
+{
+	silk_darrT(silk_size) path;
+	silk_dstr names;
+	silk_kv_range range;
+	silk_kv current;
+	silk_size node = start;
+	silk_size linked = SILK_NPOS;
+	silk_size i = 0;
+
+	silk_darrT_init(&path);
+	silk_dstr_init(&names);
+
+	/* Every project which is never ready links at least one other project which is never ready,
+	   following them ends in a cycle. */
+	for (;;)
+	{
+		for (i = 0; i < silk_darrT_size(&path) && silk_darrT_at(&path, i) != node; ++i)
+		{
+		}
+
+		if (i < silk_darrT_size(&path))
+		{
+			break;
+		}
+
+		silk_darrT_push_back(&path, node);
+
+		range = silk_mmap_get_range_str(&graph->nodes[node].project->mmap, silk_LINK_PROJECTS);
+		while (silk_mmap_range_get_next(&range, &current))
+		{
+			linked = silk_bake_graph_find(graph, current.u.strv);
+			if (graph->nodes[linked].pending > 0)
+			{
+				break;
+			}
+		}
+		node = linked;
+	}
+
+	for (; i < silk_darrT_size(&path); ++i)
+	{
+		silk_dstr_append_f(&names, "'%s' -> ", graph->nodes[silk_darrT_at(&path, i)].project->name.data);
+	}
+	silk_log_error("Projects link each other: %s'%s'.", names.data, graph->nodes[node].project->name.data);
+
+	silk_darrT_destroy(&path);
+	silk_dstr_destroy(&names);
+}
+
+SILK_INTERNAL void
+silk_bake_graph_worker(void* user_data)
+{
+	silk_bake_graph* graph = (silk_bake_graph*)user_data;
+	silk_bake_node* node = NULL;
+	const char* artefact = NULL;
+	silk_size tmp_index = 0;
+	silk_size i = 0;
+	silk_size ready = 0;
+	silk_size dependent = 0;
+
+	silk_mutex_lock(&graph->mutex);
+	for (;;)
+	{
+		/* Wait until a project is ready or until all projects are baked */
+		while (!graph->failed && graph->remaining > 0 && silk_darrT_size(&graph->ready) == 0)
+		{
+			silk_cond_wait(&graph->cond, &graph->mutex);
+		}
+
+		if (graph->failed || graph->remaining == 0)
+		{
+			break;
+		}
+
+		/* Start the longest chain of projects first */
+		ready = silk_darrT_size(&graph->ready) - 1;
+		for (i = ready; i > 0; --i)
+		{
+			if (graph->nodes[silk_darrT_at(&graph->ready, i - 1)].critical_path > graph->nodes[silk_darrT_at(&graph->ready, ready)].critical_path)
+			{
+				ready = i - 1;
+			}
+		}
+		node = &graph->nodes[silk_darrT_at(&graph->ready, ready)];
+		silk_darrT_remove(&graph->ready, ready);
+		silk_mutex_unlock(&graph->mutex);
+
+		tmp_index = silk_tmp_save();
+		artefact = graph->toolchain.bake(&graph->toolchain, node->project->name.data);
+		if (artefact)
+		{
+			silk_log_important("%s", artefact);
+		}
+		else
+		{
+			silk_log_error("Could not bake project '%s'.", node->project->name.data);
+		}
+		silk_tmp_restore(tmp_index);
+
+		silk_mutex_lock(&graph->mutex);
+		graph->remaining -= 1;
+		graph->failed = graph->failed || !artefact;
+		for (i = 0; artefact && i < silk_darrT_size(&node->dependents); ++i)
+		{
+			dependent = silk_darrT_at(&node->dependents, i);
+			graph->nodes[dependent].pending -= 1;
+			if (graph->nodes[dependent].pending == 0)
+			{
+				silk_darrT_push_back(&graph->ready, dependent);
+			}
+		}
+		silk_cond_broadcast(&graph->cond);
+	}
+	silk_mutex_unlock(&graph->mutex);
+}
+
+SILK_API silk_bool
+silk_bake_all_with(silk_toolchain toolchain)
+{
+	silk_bake_graph graph;
+	silk_bake_node* node = NULL;
+	silk_context* ctx = silk_current_context();
+	silk_thread* threads = NULL;
+	silk_size thread_count = 0;
+	silk_size worker_count = silk_get_job_count();
+	silk_kv_range range;
+	silk_kv current;
+	silk_size linked = 0;
+	silk_size i = 0;
+	silk_size j = 0;
+	silk_size tmp_index = 0;
+	silk_db db;              /* Durations of the commands the previous times */
+	silk_summary summary;
+	silk_bool result = silk_false;
+
+	silk_summary_begin(&summary);
+	silk_db_init(&db);
+
+	memset(&graph, 0, sizeof(silk_bake_graph));
+	graph.toolchain = toolchain;
+	graph.count = silk_darrT_size(&ctx->projects);
+	graph.nodes = (silk_bake_node*)SILK_MALLOC((graph.count + 1) * sizeof(silk_bake_node));
+	SILK_ASSERT(graph.nodes);
+	silk_darrT_init(&graph.ready);
+	silk_mutex_init(&graph.mutex);
+	silk_cond_init(&graph.cond);
+
+	for (i = 0; i < graph.count; ++i)
+	{
+		graph.nodes[i].project = (silk_project_t*)silk_darrT_at(&ctx->projects, i).u.ptr;
+		graph.nodes[i].pending = 0;
+		silk_darrT_init(&graph.nodes[i].dependents);
+	}
+
+	/* Each project waits for the projects it links */
+	for (i = 0; i < graph.count; ++i)
+	{
+		range = silk_mmap_get_range_str(&graph.nodes[i].project->mmap, silk_LINK_PROJECTS);
+		while (silk_mmap_range_get_next(&range, &current))
+		{
+			linked = silk_bake_graph_find(&graph, current.u.strv);
+			if (linked == SILK_NPOS)
+			{
+				silk_log_error("Project '%s' links unknown project '%.*s'.", graph.nodes[i].project->name.data, (int)current.u.strv.size, current.u.strv.data);
+				silk_set_and_goto(result, silk_false, exit);
+			}
+			silk_darrT_push_back(&graph.nodes[linked].dependents, i);
+			graph.nodes[i].pending += 1;
+		}
+	}
+
+	/* Projects are removed from the graph in the order they would be baked, the ones left are part of a cycle or link one. */
+	for (i = 0; i < graph.count; ++i)
+	{
+		if (graph.nodes[i].pending == 0)
+		{
+			silk_darrT_push_back(&graph.ready, i);
+		}
+	}
+
+	for (i = 0; i < silk_darrT_size(&graph.ready); ++i)
+	{
+		node = &graph.nodes[silk_darrT_at(&graph.ready, i)];
+		for (j = 0; j < silk_darrT_size(&node->dependents); ++j)
+		{
+			linked = silk_darrT_at(&node->dependents, j);
+			graph.nodes[linked].pending -= 1;
+			if (graph.nodes[linked].pending == 0)
+			{
+				silk_darrT_push_back(&graph.ready, linked);
+			}
+		}
+	}
+
+	if (silk_darrT_size(&graph.ready) < graph.count)
+	{
+		for (i = 0; graph.nodes[i].pending == 0; ++i)
+		{
+		}
+		silk_bake_graph_log_cycle(&graph, i);
+		silk_set_and_goto(result, silk_false, exit);
+	}
+
+	/* Linked projects come before the projects linking them in 'ready', so the chains are computed from the end. */
+	for (i = graph.count; i > 0; --i)
+	{
+		node = &graph.nodes[silk_darrT_at(&graph.ready, i - 1)];
+
+		tmp_index = silk_tmp_save();
+		silk_db_open(&db, silk_db_path(silk_get_output_directory(node->project, &graph.toolchain), node->project->name.data));
+		silk_tmp_restore(tmp_index);
+
+		node->critical_path = 0;
+		for (j = 0; j < silk_darrT_size(&node->dependents); ++j)
+		{
+			linked = silk_darrT_at(&node->dependents, j);
+			node->critical_path = graph.nodes[linked].critical_path > node->critical_path ? graph.nodes[linked].critical_path : node->critical_path;
+		}
+		node->critical_path += silk_db_total_duration(&db);
+	}
+
+	/* Restore the number of linked projects consumed by the check */
+	graph.ready.darr.size = 0;
+	for (i = 0; i < graph.count; ++i)
+	{
+		for (j = 0; j < silk_darrT_size(&graph.nodes[i].dependents); ++j)
+		{
+			graph.nodes[silk_darrT_at(&graph.nodes[i].dependents, j)].pending += 1;
+		}
+	}
+
+	/* Projects are pushed in reverse order so the first declared project is baked first */
+	for (i = graph.count; i > 0; --i)
+	{
+		if (graph.nodes[i - 1].pending == 0)
+		{
+			silk_darrT_push_back(&graph.ready, i - 1);
+		}
+	}
+	graph.remaining = graph.count;
+
+	/* Each worker bakes one project at a time, the commands of all projects share the job slots. */
+	worker_count = worker_count < graph.count ? worker_count : graph.count;
+
+	if (worker_count > 1)
+	{
+		threads = (silk_thread*)SILK_MALLOC((worker_count - 1) * sizeof(silk_thread));
+		SILK_ASSERT(threads);
+
+		for (i = 0; i < worker_count - 1; ++i)
+		{
+			if (!silk_thread_start(&threads[thread_count], silk_bake_graph_worker, &graph))
+			{
+				silk_log_warning("Could not start worker thread, running with %d worker(s).", (int)thread_count + 1);
+				break;
+			}
+			thread_count += 1;
+		}
+	}
+
+	silk_bake_graph_worker(&graph);
+
+	for (i = 0; i < thread_count; ++i)
+	{
+		silk_thread_join(&threads[i]);
+	}
+
+	if (threads)
+	{
+		SILK_FREE(threads);
+	}
+
+	result = !graph.failed;
+
+	silk_cache_report();
+	silk_summary_report(&summary);
+	silk_trace_write();
+	if (!silk_dry_run_enabled)
+	{
+		silk_compile_commands_write();
+	}
+
+exit:
+	for (i = 0; i < graph.count; ++i)
+	{
+		silk_darrT_destroy(&graph.nodes[i].dependents);
+	}
+	SILK_FREE(graph.nodes);
+	silk_darrT_destroy(&graph.ready);
+	silk_mutex_destroy(&graph.mutex);
+	silk_cond_destroy(&graph.cond);
+	silk_db_destroy(&db);
+
+	return result;
+}
+
+SILK_API silk_bool
+silk_bake_all(void)
+{
+	return silk_bake_all_with(silk_toolchain_default());
+}
+
+SILK_API void
+silk_debug(silk_bool value)
+{
+	silk_debug_enabled = value;
+}
+
+SILK_API void
+silk_buffered_output(silk_bool value)
+{
+	silk_buffered_output_enabled = value;
+}
+
+SILK_API void
+silk_jobs(silk_size count)
+{
+	silk_job_count = count;
+}
+
+/* Limits given to the next process handles, see silk_process_timeout and the others. */
+static double silk_process_timeout_ms = 0;
+static silk_size silk_process_memory_limit_bytes = 0;
+static silk_size silk_process_cpu_limit_seconds = 0;
+static silk_bool silk_process_group_enabled = silk_false;
+static silk_bool silk_process_fork_enabled = silk_false; /* Start the commands with fork instead of posix_spawn, to compare them */
+
+struct silk_process_handle {
+	const char* cmd;            /* NULL when the arguments are given as is. */
+	const char* const* argv;    /* Arguments given as is, NULL when 'cmd' is parsed. */
+	const char* const* env;     /* Environment of the process, NULL to inherit the one of silk. */
+	const char* starting_directory;
+	silk_bool stdout_to_string; /* If stdout needs to be copied to a string. */
+	silk_bool stderr_to_string; /* If stderr needs to be copied to a string. */
+	silk_bool merge_stderr;     /* stderr is also copied to stdout_string, in the order it's written. Only with stdout_to_string. */
+	silk_bool quiet;            /* A failure is expected and not reported (checking if a program is installed, etc.). */
+	silk_dstr stdout_string;    /* If stdout_to_string has been set to true. */
+	silk_dstr stderr_string;    /* If stderr_to_string has been set to true. */
+	int exit_code;
+	double duration;            /* Milliseconds from the start of the process to its exit. */
+	double start_time;
+	silk_bool running;          /* Started by silk_process_start and not over yet. */
+	double timeout;             /* Milliseconds, 0 for no limit. */
+	silk_size memory_limit;     /* Bytes of address space, 0 for no limit. */
+	silk_size cpu_limit;        /* Seconds of CPU time, 0 for no limit. */
+	silk_bool own_group;        /* Run in its own process group, which is terminated with the process. */
+	silk_bool timed_out;        /* Terminated after running out of time, then killed at 'kill_time'. */
+	silk_bool killed;
+	double kill_time;
+#if _WIN32
+	HANDLE process;
+	HANDLE stdout_pipe;         /* Read end of the pipes, NULL when not used. */
+	HANDLE stderr_pipe;
+	silk_thread stdout_thread;  /* Threads reading the pipes of the processes started by silk_process_start. */
+	silk_thread stderr_thread;
+#else
+	pid_t pid;
+	int stdout_fd;              /* Read end of the pipes, -1 when closed or not used. */
+	int stderr_fd;
+	int pidfd;                  /* Readable when the process exits, -1 when not supported. */
+	int group_slot;             /* Index in silk_process_groups, -1 if not registered. */
+	silk_bool reaped;           /* wait_status is set, the pipes may still be open (inherited by a grand child, etc.) */
+	int wait_status;
+#endif
+};
+
+/* Run the process of the handle and wait for it. */
+SILK_INTERNAL silk_process_handle* silk_process_run_core(silk_process_handle* handle);
+/* Start the process of the handle without waiting for it. */
+SILK_INTERNAL void silk_process_start_core(silk_process_handle* handle);
+/* Read the outputs and reap the processes that exited, waits up to 'timeout_ms' (-1 for no limit) for something to happen. */
+SILK_INTERNAL void silk_process_update(silk_process_handle** handles, silk_size count, int timeout_ms);
+/* Ask the process (and its group) to terminate, or kill it if 'force' is true. */
+SILK_INTERNAL void silk_process_kill(silk_process_handle* handle, silk_bool force);
+#if !_WIN32
+/* Forward the signals interrupting silk to the process groups of the running commands. */
+SILK_INTERNAL void silk_forward_interrupts(void);
+#endif
+
+SILK_API void
+silk_process_timeout(double seconds)
+{
+	silk_process_timeout_ms = seconds * 1000.0;
+}
+
+SILK_API void
+silk_process_memory_limit(silk_size bytes)
+{
+	silk_process_memory_limit_bytes = bytes;
+}
+
+SILK_API void
+silk_process_cpu_limit(silk_size seconds)
+{
+	silk_process_cpu_limit_seconds = seconds;
+}
+
+SILK_API void
+silk_process_group(silk_bool value)
+{
+	silk_process_group_enabled = value;
+#if !_WIN32
+	if (value)
+	{
+		silk_forward_interrupts();
+	}
+#endif
+}
+
+/* Command of the handle for the messages, the arguments given as is are quoted when needed. */
+SILK_INTERNAL const char*
+silk_process_command(silk_process_handle* handle)
+{
+	silk_dstr cmd;
+	const char* result = NULL;
+	silk_size i = 0;
+
+	if (handle->cmd)
+	{
+		return handle->cmd;
+	}
+
+	silk_dstr_init(&cmd);
+	for (i = 0; handle->argv[i] != NULL; ++i)
+	{
+		silk_dstr_append_f(&cmd, strpbrk(handle->argv[i], " \t") ? "%s\"%s\"" : "%s%s", i > 0 ? " " : "", handle->argv[i]);
+	}
+	result = silk_tmp_sprintf("%s", cmd.data);
+	silk_dstr_destroy(&cmd);
+	return result;
+}
+
+/* Milliseconds after the termination of a process that timed out before it's killed. */
+#define SILK_PROCESS_KILL_DELAY 1000
+
+/* Terminate the process if it ran out of time, 'timeout_ms' is lowered to its next deadline. */
+SILK_INTERNAL void
+silk_process_check_deadline(silk_process_handle* handle, double now, int* timeout_ms)
+{
+	double deadline = handle->start_time + handle->timeout;
+	int remaining = 0;
+
+	if (handle->timeout <= 0 || handle->killed)
+	{
+		return;
+	}
+
+	if (handle->timed_out)
+	{
+		deadline = handle->kill_time;
+	}
+
+	if (now >= deadline && handle->timed_out)
+	{
+		silk_process_kill(handle, silk_true);
+		handle->killed = silk_true;
+		return;
+	}
+
+	if (now >= deadline)
+	{
+		silk_log_error("Command timed out after %.1fs: %s", handle->timeout / 1000.0, silk_process_command(handle));
+		silk_process_kill(handle, silk_false);
+		handle->timed_out = silk_true;
+		handle->kill_time = now + SILK_PROCESS_KILL_DELAY;
+		deadline = handle->kill_time;
+	}
+
+	remaining = (int)(deadline - now) + 1;
+	if (*timeout_ms < 0 || *timeout_ms > remaining)
+	{
+		*timeout_ms = remaining;
+	}
+}
+
+/* Commands with a deadline are run by the loop of the processes started without waiting. */
+SILK_INTERNAL silk_process_handle*
+silk_process_core(silk_process_handle* handle)
+{
+	if (handle->timeout <= 0)
+	{
+		return silk_process_run_core(handle);
+	}
+
+	silk_process_start_core(handle);
+	while (handle->running)
+	{
+		silk_process_update(&handle, 1, -1);
+	}
+	return handle;
+}
+
+SILK_INTERNAL silk_process_handle*
+silk_create_process_handle(const char* cmd, const char* starting_directory)
+{
+	silk_process_handle* handle = (silk_process_handle*)silk_tmp_alloc(sizeof(silk_process_handle));
+	memset(handle, 0, sizeof(silk_process_handle));
+
+	handle->cmd = cmd;
+	handle->starting_directory = starting_directory;
+	handle->exit_code = -1;
+#if !_WIN32
+	handle->stdout_fd = -1;
+	handle->stderr_fd = -1;
+	handle->pidfd = -1;
+	handle->group_slot = -1;
+#endif
+	handle->timeout = silk_process_timeout_ms;
+	handle->memory_limit = silk_process_memory_limit_bytes;
+	handle->cpu_limit = silk_process_cpu_limit_seconds;
+	handle->own_group = silk_process_group_enabled;
+
+	silk_dstr_init(&handle->stdout_string);
+	silk_dstr_init(&handle->stderr_string);
+
+	return handle;
+}
+
+SILK_API int
+silk_process(const char* cmd)
+{
+	return silk_process_in_directory(cmd, NULL);
+}
+
+/* Run the command of the handle, its output is printed at once when it exits if 'buffered' is true. */
+SILK_INTERNAL int
+silk_process_in_directory_core(silk_process_handle* handle, silk_bool buffered)
+{
+	silk_jobserver_setup(); /* Nested builds find the jobserver in MAKEFLAGS */
+
+	if (buffered)
+	{
+		handle->stdout_to_string = silk_true;
+		handle->stderr_to_string = silk_true;
+		handle->merge_stderr = silk_true;
+		handle->quiet = silk_true; /* The failure is reported with the output */
+	}
+
+	handle = silk_process_core(handle);
+
+	/* Written with a single call so it's not mixed with the output of other commands */
+	if (buffered && handle->exit_code != 0)
+	{
+		fprintf(stderr, "[SILK-ERROR] Command failed: %s\n%.*s%.*s", silk_process_command(handle),
+			(int)handle->stdout_string.size, handle->stdout_string.data,
+			(int)handle->stderr_string.size, handle->stderr_string.data);
+	}
+	else if (buffered && (handle->stdout_string.size > 0 || handle->stderr_string.size > 0))
+	{
+		fprintf(stdout, "%.*s%.*s",
+			(int)handle->stdout_string.size, handle->stdout_string.data,
+			(int)handle->stderr_string.size, handle->stderr_string.data);
+	}
+
+	return silk_process_end(handle);
+}
+
+SILK_API int
+silk_process_in_directory(const char* cmd, const char* starting_directory)
+{
+	return silk_process_in_directory_core(silk_create_process_handle(cmd, starting_directory), silk_buffered_output_enabled);
+}
+
+/* Handle of a command whose arguments are given as is. */
+SILK_INTERNAL silk_process_handle*
+silk_create_process_handle_argv(const char* const* argv, const char* starting_directory, const char* const* env)
+{
+	silk_process_handle* handle = silk_create_process_handle(NULL, starting_directory);
+
+	handle->argv = argv;
+	handle->env = env;
+
+	return handle;
+}
+
+SILK_API int
+silk_process_argv(const char* const* argv, const char* directory, const char* const* env)
+{
+	return silk_process_in_directory_core(silk_create_process_handle_argv(argv, directory, env), silk_buffered_output_enabled);
+}
+
+SILK_API silk_process_handle*
+silk_process_argv_to_string(const char* const* argv, const char* starting_directory, const char* const* env, silk_bool also_get_stderr)
+{
+	silk_process_handle* handle = silk_create_process_handle_argv(argv, starting_directory, env);
+
+	handle->stdout_to_string = silk_true;
+	handle->stderr_to_string = also_get_stderr;
+
+	return silk_process_core(handle);
+}
+
+SILK_API silk_process_handle*
+silk_process_argv_start(const char* const* argv, const char* starting_directory, const char* const* env, silk_bool also_get_stderr)
+{
+	silk_process_handle* handle = silk_create_process_handle_argv(argv, starting_directory, env);
+
+	handle->stdout_to_string = silk_true;
+	handle->stderr_to_string = also_get_stderr;
+
+	silk_process_start_core(handle);
+	return handle;
+}
+
+SILK_API silk_process_handle*
+silk_process_to_string(const char* cmd, const char* starting_directory, silk_bool also_get_stderr)
+{
+	silk_process_handle* handle = silk_create_process_handle(cmd, starting_directory);
+
+	handle->stdout_to_string = silk_true;
+	handle->stderr_to_string = also_get_stderr;
+
+	return silk_process_core(handle);
+}
+
+SILK_API int
+silk_run(const char* executable_path)
+{
+	const char** argv = (const char**)silk_tmp_alloc(2 * sizeof(const char*));
+	argv[0] = executable_path;
+	argv[1] = NULL;
+
+	/* Programs run by the user print their output as they go */
+	return silk_process_in_directory_core(silk_create_process_handle_argv(argv, NULL, NULL), silk_false);
+}
+
+SILK_API const char*
+silk_process_stdout_string(silk_process_handle* handle)
+{
+	return handle->stdout_string.data;
+}
+
+SILK_API const char*
+silk_process_stderr_string(silk_process_handle* handle)
+{
+	return handle->stderr_string.data;
+}
+
+SILK_API silk_process_handle*
+silk_process_start(const char* cmd, const char* starting_directory, silk_bool also_get_stderr)
+{
+	silk_process_handle* handle = silk_create_process_handle(cmd, starting_directory);
+
+	handle->stdout_to_string = silk_true;
+	handle->stderr_to_string = also_get_stderr;
+
+	silk_process_start_core(handle);
+	return handle;
+}
+
+SILK_API silk_bool
+silk_process_poll(silk_process_handle* handle)
+{
+	if (handle->running)
+	{
+		silk_process_update(&handle, 1, 0);
+	}
+	return !handle->running;
+}
+
+SILK_API int
+silk_process_wait_any(silk_process_handle** handles, silk_size count)
+{
+	silk_bool any_process = silk_false;
+	silk_size i = 0;
+
+	for (;;)
+	{
+		any_process = silk_false;
+		for (i = 0; i < count; ++i)
+		{
+			if (handles[i] != NULL && !handles[i]->running)
+			{
+				return (int)i;
+			}
+			any_process = any_process || handles[i] != NULL;
+		}
+
+		if (!any_process)
+		{
+			return -1;
+		}
+		silk_process_update(handles, count, -1);
+	}
+}
+
+SILK_API int
+silk_process_end(silk_process_handle* handle)
+{
+	while (handle->running)
+	{
+		silk_process_update(&handle, 1, -1);
+	}
+
+	silk_summary_add_process(handle->duration);
+	silk_dstr_destroy(&handle->stdout_string);
+	silk_dstr_destroy(&handle->stderr_string);
+
+	return handle->exit_code;
+}
+
+#if _WIN32
+
+/* #process */
+
+/* Output of the processes is read by blocks of this size, in place at the end of the string. */
+#define SILK_PIPE_READ_SIZE (64 * 1024)
+
+/* Read the pipe until the child process closes it. */
+SILK_INTERNAL void
+silk_read_pipe(HANDLE pipe, silk_dstr* output)
+{
+	DWORD bytes_read = 0;
+	while (ReadFile(pipe, silk_dstr_tail_space(output, SILK_PIPE_READ_SIZE), SILK_PIPE_READ_SIZE, &bytes_read, NULL) && bytes_read != 0)
+	{
+		silk_dstr_expand(output, bytes_read);
+	}
+}
+
+SILK_INTERNAL void
+silk_read_stdout_run(void* user_data)
+{
+	silk_process_handle* handle = (silk_process_handle*)user_data;
+	silk_read_pipe(handle->stdout_pipe, &handle->stdout_string);
+}
+
+SILK_INTERNAL void
+silk_read_stderr_run(void* user_data)
+{
+	silk_process_handle* handle = (silk_process_handle*)user_data;
+	silk_read_pipe(handle->stderr_pipe, &handle->stderr_string);
+}
+
+/* Command line of the arguments given as is, quoted the way CommandLineToArgvW splits them. Allocated in the temp buffer. */
+SILK_INTERNAL const char*
+silk_windows_command_line(const char* const* argv)
+{
+	silk_dstr line;
+	const char* arg = NULL;
+	const char* result = NULL;
+	silk_size backslashes = 0;
+	silk_size i = 0;
+
+	silk_dstr_init(&line);
+	for (i = 0; argv[i] != NULL; ++i)
+	{
+		arg = argv[i];
+		if (i > 0)
+		{
+			silk_dstr_append_str(&line, " ");
+		}
+		if (arg[0] != '\0' && !strpbrk(arg, " \t\""))
+		{
+			silk_dstr_append_str(&line, arg);
+			continue;
+		}
+
+		/* Backslashes are only escaped before a quote */
+		silk_dstr_append_str(&line, "\"");
+		for (;; ++arg)
+		{
+			for (backslashes = 0; *arg == '\\'; ++arg)
+			{
+				backslashes += 1;
+			}
+			backslashes = *arg == '\0' ? 2 * backslashes : (*arg == '"' ? 2 * backslashes + 1 : backslashes);
+			for (; backslashes > 0; --backslashes)
+			{
+				silk_dstr_append_str(&line, "\\");
+			}
+			if (*arg == '\0')
+			{
+				break;
+			}
+			silk_dstr_append_from(&line, line.size, arg, 1);
+		}
+		silk_dstr_append_str(&line, "\"");
+	}
+
+	result = silk_tmp_sprintf("%s", line.data);
+	silk_dstr_destroy(&line);
+	return result;
+}
+
+/* Environment block of CreateProcessW from "NAME=value" strings. Allocated in the temp buffer. */
+SILK_INTERNAL wchar_t*
+silk_windows_environment_block(const char* const* env)
+{
+	wchar_t* block = NULL;
+	wchar_t* cursor = NULL;
+	silk_size size = 1; /* Terminated by an empty string */
+	int length = 0;
+	silk_size i = 0;
+
+	for (i = 0; env[i] != NULL; ++i)
+	{
+		size += MultiByteToWideChar(CP_UTF8, 0, env[i], -1, NULL, 0);
+	}
+
+	block = (wchar_t*)silk_tmp_alloc(size * sizeof(wchar_t));
+	cursor = block;
+	for (i = 0; env[i] != NULL; ++i)
+	{
+		length = MultiByteToWideChar(CP_UTF8, 0, env[i], -1, NULL, 0);
+		MultiByteToWideChar(CP_UTF8, 0, env[i], -1, cursor, length);
+		cursor += length;
+	}
+	*cursor = L'\0';
+
+	return block;
+}
+
+/* Start the process of the handle, its outputs are read from handle->stdout_pipe and handle->stderr_pipe. */
+SILK_INTERNAL silk_bool
+silk_process_launch(silk_process_handle* handle)
+{
+	HANDLE process_stdout_write = NULL; /* Pipe (write) for stdout of the child process */
+	HANDLE process_stderr_write = NULL; /* Pipe (write) for stderr of the child process */
+	SECURITY_ATTRIBUTES saAttr;         /* To create the pipes. */
+	BOOL handles_inheritance = 0;
+
+	wchar_t* cmd_w = silk_utf8_to_utf16(handle->cmd ? handle->cmd : silk_windows_command_line(handle->argv));
+	wchar_t* env_w = handle->env ? silk_windows_environment_block(handle->env) : NULL;
+	wchar_t* starting_directory_w = NULL;
+
+	handle->start_time = silk_time_ms();
+
+	silk_log_debug("Running process '%s'", silk_process_command(handle));
+	if (handle->starting_directory && handle->starting_directory[0])
+	{
+		starting_directory_w = silk_utf8_to_utf16(handle->starting_directory);
+		silk_log_debug("Subprocess started in directory '%s'", handle->starting_directory);
+	}
+
+	/* Ensure that everything is written into the outputs before creating a new process that will also write in those outputs */
+	fflush(stdout);
+	fflush(stderr);
+
+	STARTUPINFOW si;
+	PROCESS_INFORMATION pi;
+
+	ZeroMemory(&si, sizeof(si));
+	si.cb = sizeof(si);
+
+	if (handle->stdout_to_string
+		|| handle->stderr_to_string)
+	{
+		handles_inheritance = TRUE;
+
+		si.hStdOutput = GetStdHandle(STD_OUTPUT_HANDLE);
+		si.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+		si.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+
+		si.dwFlags |= STARTF_USESTDHANDLES;
+			
+		saAttr.nLength = sizeof(SECURITY_ATTRIBUTES);
+		saAttr.bInheritHandle = TRUE;
+		saAttr.lpSecurityDescriptor = NULL;
+
+		if (handle->stdout_to_string)
+		{
+			/* Create a pipe for the child process's stdout. */
+			if (!CreatePipe(&handle->stdout_pipe, &process_stdout_write, &saAttr, 0)
+				|| !SetHandleInformation(handle->stdout_pipe, HANDLE_FLAG_INHERIT, 0))
+			{
+				silk_log_error("Could not create pipe for stdout.");
+				exit(1);
+			}
+
+			si.hStdOutput = process_stdout_write;
+		}
+
+		if (handle->stdout_to_string && handle->merge_stderr)
+		{
+			si.hStdError = process_stdout_write;
+		}
+		else if (handle->stderr_to_string)
+		{
+			/* Create a pipe for the child process's stderr. */
+			if (!CreatePipe(&handle->stderr_pipe, &process_stderr_write, &saAttr, 0)
+				|| !SetHandleInformation(handle->stderr_pipe, HANDLE_FLAG_INHERIT, 0))
+			{
+				silk_log_error("Could not create pipe for stderr.");
+				exit(1);
+			}
+
+			si.hStdError = process_stderr_write;
+		}
+	}
+
+	ZeroMemory(&pi, sizeof(pi));
+
+	/* Start the child process.
+	*  NOTE: we use CreateProcessW because CreateProcessA (with /utf-8) cannot create path with unicode.
+	*/
+	if (!CreateProcessW(
+		NULL,                 /* No module name (use command line) */
+		cmd_w,                /* Command line */
+		NULL,                 /* Process handle not inheritable */
+		NULL,                 /* Thread handle not inheritable */ 
+		handles_inheritance,  /* Set handle inheritance */
+		env_w ? CREATE_UNICODE_ENVIRONMENT : 0, /* Creation flags */
+		env_w,                /* Environment block, parent's one if NULL */
+		starting_directory_w, /* Use parent's starting directory */
+		&si,                  /* Pointer to STARTUPINFO structure */
+		&pi)                  /* Pointer to PROCESS_INFORMATION structure */
+		)
+	{
+		silk_log_error("CreateProcessW failed: %d", GetLastError());
+	}
+
+	/* Close the write ends of the pipes since they will not be used in the parent process. */
+	if (process_stdout_write)
+		CloseHandle(process_stdout_write);
+	if (process_stderr_write)
+		CloseHandle(process_stderr_write);
+
+	if (pi.hThread)
+		CloseHandle(pi.hThread);
+	handle->process = pi.hProcess;
+	return pi.hProcess != NULL;
+}
+
+/* Wait for the process, its outputs must have been read. */
+SILK_INTERNAL DWORD
+silk_process_wait(silk_process_handle* handle)
+{
+	DWORD exit_code = (DWORD) -1;
+	DWORD wait_result = WaitForSingleObject(
+		handle->process, /* HANDLE hHandle, */
+		INFINITE         /* DWORD  dwMilliseconds */
+	);
+
+	if (wait_result == WAIT_FAILED)
+	{
+		silk_log_error("Could not wait on child process: %lu", GetLastError());
+	}
+	else
+	{
+		if (GetExitCodeProcess(handle->process, &exit_code))
+		{
+			if (exit_code != 0 && !handle->quiet)
+			{
+				silk_log_error("Command exited with exit code %lu", exit_code);
+			}
+		}
+		else
+		{
+			silk_log_error("Could not get process exit code: %lu", GetLastError());
+		}
+	}
+	return exit_code;
+}
+
+/* Release what is left of the process once it's over. */
+SILK_INTERNAL void
+silk_process_close(silk_process_handle* handle, DWORD exit_code)
+{
+	if (handle->stdout_pipe)
+	{
+		CloseHandle(handle->stdout_pipe);
+		handle->stdout_pipe = NULL;
+	}
+	if (handle->stderr_pipe)
+	{
+		CloseHandle(handle->stderr_pipe);
+		handle->stderr_pipe = NULL;
+	}
+	if (handle->process)
+	{
+		CloseHandle(handle->process);
+		handle->process = NULL;
+	}
+
+	handle->running = silk_false;
+	handle->exit_code = exit_code;
+	handle->duration = silk_time_ms() - handle->start_time;
+}
+
+SILK_INTERNAL silk_process_handle*
+silk_process_run_core(silk_process_handle* handle)
+{
+	if (!silk_process_launch(handle))
+	{
+		silk_process_close(handle, (DWORD) -1);
+		return handle;
+	}
+
+	/* Read the outputs before waiting, the child process blocks when a pipe is full.
+	   Anonymous pipes can't be waited on, so stderr is read by another thread when both are read,
+	   a child blocked on a full stderr while stdout is read would never exit. */
+	if (handle->stdout_pipe && handle->stderr_pipe)
+	{
+		silk_thread_start(&handle->stderr_thread, silk_read_stderr_run, handle);
+	}
+
+	if (handle->stdout_pipe)
+	{
+		silk_read_pipe(handle->stdout_pipe, &handle->stdout_string);
+	}
+
+	if (handle->stderr_pipe)
+	{
+		if (handle->stdout_pipe)
+		{
+			silk_thread_join(&handle->stderr_thread);
+		}
+		else
+		{
+			silk_read_pipe(handle->stderr_pipe, &handle->stderr_string);
+		}
+	}
+
+	silk_process_close(handle, silk_process_wait(handle));
+	return handle;
+}
+
+SILK_INTERNAL void
+silk_process_kill(silk_process_handle* handle, silk_bool force)
+{
+	(void)force; /* Windows processes can't be asked to terminate */
+	TerminateProcess(handle->process, 1);
+}
+
+/* Processes are checked at this interval (milliseconds) when there are too many to be waited on at once. */
+#define SILK_PROCESS_REAP_INTERVAL 10
+
+SILK_INTERNAL void
+silk_process_start_core(silk_process_handle* handle)
+{
+	if (!silk_process_launch(handle))
+	{
+		silk_process_close(handle, (DWORD) -1);
+		return;
+	}
+
+	/* The pipes are read by threads until the process is over */
+	if (handle->stdout_pipe)
+	{
+		silk_thread_start(&handle->stdout_thread, silk_read_stdout_run, handle);
+	}
+	if (handle->stderr_pipe)
+	{
+		silk_thread_start(&handle->stderr_thread, silk_read_stderr_run, handle);
+	}
+	handle->running = silk_true;
+}
+
+SILK_INTERNAL void
+silk_process_update(silk_process_handle** handles, silk_size count, int timeout_ms)
+{
+	HANDLE processes[MAXIMUM_WAIT_OBJECTS];
+	DWORD process_count = 0;
+	DWORD timeout = INFINITE;
+	silk_process_handle* handle = NULL;
+	double now = silk_time_ms();
+	silk_size i = 0;
+
+	for (i = 0; i < count; ++i)
+	{
+		if (handles[i] != NULL && handles[i]->running)
+		{
+			silk_process_check_deadline(handles[i], now, &timeout_ms);
+		}
+	}
+	timeout = timeout_ms < 0 ? INFINITE : (DWORD)timeout_ms;
+
+	for (i = 0; i < count; ++i)
+	{
+		if (handles[i] == NULL || !handles[i]->running)
+		{
+			continue;
+		}
+		if (process_count == MAXIMUM_WAIT_OBJECTS)
+		{
+			/* The others are checked at the next call */
+			timeout = timeout < SILK_PROCESS_REAP_INTERVAL ? timeout : SILK_PROCESS_REAP_INTERVAL;
+			break;
+		}
+		processes[process_count++] = handles[i]->process;
+	}
+
+	if (process_count > 0 && WaitForMultipleObjects(process_count, processes, FALSE, timeout) == WAIT_FAILED)
+	{
+		silk_log_error("Could not wait on child processes: %lu", GetLastError());
+	}
+
+	for (i = 0; i < count; ++i)
+	{
+		handle = handles[i];
+		if (handle == NULL || !handle->running || WaitForSingleObject(handle->process, 0) != WAIT_OBJECT_0)
+		{
+			continue;
+		}
+
+		/* The output is complete once the pipes are closed */
+		if (handle->stdout_pipe)
+		{
+			silk_thread_join(&handle->stdout_thread);
+		}
+		if (handle->stderr_pipe)
+		{
+			silk_thread_join(&handle->stderr_thread);
+		}
+		silk_process_close(handle, handle->timed_out ? (DWORD) -1 : silk_process_wait(handle));
+	}
+}
+#else
+
+/* space or tab */
+SILK_INTERNAL silk_bool silk_is_space(char c) { return c == ' ' || c == '\t'; }
+
+SILK_INTERNAL silk_bool
+silk_is_end_of_quote(const char* str, char quote_type)
+{
+	return *str != '\0'
+		&& *str == quote_type
+		&& (str[1] == '\0' || silk_is_space(str[1]));
+
+}
+/* Parse arguments, space is a separator and everything between <space or begining of string><quote> and <quote><space or end of string>
+* Quotes can be double quotes or simple quotes.
+a b c   => 3 arguments a b c
+abc     => 1 argument "abc"
+a "b" c => 3 arguments a b c;
+a"b"c   => 1 argument a"b"c
+"a"b"c" => 1 argument a"b"c
+*/
+SILK_INTERNAL const char*
+silk_get_next_arg(const char* str, silk_strv* sv)
+{
+	sv->data = str;
+	sv->size = 0;
+	if (str == NULL || *str == '\0')
+		return NULL;
+		
+	while (*str != '\0')
+	{
+		/* Skip spaces */
+		while (*str != '\0' && silk_is_space(*str))
+			str += 1;
+
+		/* Return early if end of string */
+		if (*str == '\0') 
+			return sv->size > 0 ? str: NULL;
+
+		/* Handle quotes */
+		if (*str == '\'' || *str == '\"')
+		{
+			const char* quote = str;
+			str += 1; /* skip quote */
+			
+			/* Return early if end of string */
+			if (*str == '\0')
+				return sv->size > 0 ? str : NULL;
+
+			/* Quote next the previous one so it's an empty content, we look for another item */
+			if (silk_is_end_of_quote(str, *quote))
+			{
+				str += 1; /* Skip quote */
+				continue;
+			}
+
+			sv->data = str; /* The next argument will begin right after the quote */
+			/* Skip everything until the next unescaped quote */
+			while (*str != '\0' && !silk_is_end_of_quote(str, *quote))
+				str += 1;
+
+			/* Either it's the end of the quoted string, either we reached the null terminating string */
+			sv->size = (str - quote) - 1;
+
+			/* Eat trailing quote so that next argument can start with space */
+			while (*str != '\0' && *str == *quote)
+				str += 1;
+
+			return str;
+		}
+		else /* is char */
+		{
+			const char* ch = str;
+			while (*str != '\0' && !silk_is_space(*str))
+				str += 1;
+
+			sv->data = ch; /* remove quote */
+			sv->size = str - ch;
+			return str;
+		}
+	}
+	return NULL;
+}
+
+/* Arguments of the command as silk_get_next_arg splits them, NULL-terminated. Allocated in the tmp buffer. */
+SILK_INTERNAL const char**
+silk_tmp_split_args(const char* cmd)
+{
+	const char** args = NULL;
+	const char* cursor = cmd;
+	silk_strv arg;
+	silk_size count = 0;
+
+	while ((cursor = silk_get_next_arg(cursor, &arg)) != NULL)
+	{
+		count += 1;
+	}
+
+	args = (const char**)silk_tmp_alloc((count + 1) * sizeof(const char*));
+	for (cursor = cmd, count = 0; (cursor = silk_get_next_arg(cursor, &arg)) != NULL; ++count)
+	{
+		args[count] = silk_tmp_strv_to_str(arg);
+	}
+	args[count] = NULL;
+
+	return args;
+}
+
+#define SILK_INVALID_PROCESS (-1)
+
+/* Output of the processes is read by blocks of this size, in place at the end of the string. */
+#define SILK_PIPE_READ_SIZE (64 * 1024)
+
+static pthread_mutex_t silk_fork_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Process groups of the running commands started with silk_process_group, 0 for a free slot.
+   Read by the signal handler, which can't lock. Updated with silk_fork_mutex locked. */
+#define SILK_MAX_PROCESS_GROUPS 1024
+static volatile sig_atomic_t silk_process_groups[SILK_MAX_PROCESS_GROUPS];
+
+SILK_INTERNAL void
+silk_forward_interrupt(int signal_number)
+{
+	int i = 0;
+	for (i = 0; i < SILK_MAX_PROCESS_GROUPS; ++i)
+	{
+		if (silk_process_groups[i] != 0)
+		{
+			kill(-(pid_t)silk_process_groups[i], signal_number);
+		}
+	}
+
+	/* Then silk is interrupted as it would have been */
+	signal(signal_number, SIG_DFL);
+	raise(signal_number);
+}
+
+SILK_INTERNAL void
+silk_forward_interrupts(void)
+{
+	void (*previous)(int) = NULL;
+	int signals[3];
+	int i = 0;
+
+	signals[0] = SIGINT;
+	signals[1] = SIGTERM;
+	signals[2] = SIGHUP;
+	for (i = 0; i < 3; ++i)
+	{
+		/* The handlers set by the silkfile are kept */
+		previous = signal(signals[i], silk_forward_interrupt);
+		if (previous != SIG_DFL && previous != SIG_ERR)
+		{
+			signal(signals[i], previous);
+		}
+	}
+}
+
+/* Read what the pipe holds, it's closed and set to -1 when the child process closed it. */
+SILK_INTERNAL void
+silk_read_pipe(int* fd, silk_dstr* output)
+{
+	ssize_t bytes_read = read(*fd, silk_dstr_tail_space(output, SILK_PIPE_READ_SIZE), SILK_PIPE_READ_SIZE);
+	if (bytes_read > 0)
+	{
+		silk_dstr_expand(output, (silk_size)bytes_read);
+	}
+	else if (bytes_read == 0 || errno != EINTR)
+	{
+		close(*fd);
+		*fd = -1;
+	}
+}
+
+/* Read the pipes of the process until the child process closes them. Both are read as the data comes,
+   a child blocked on a full stderr while stdout is read would never exit. */
+SILK_INTERNAL void
+silk_read_pipes(silk_process_handle* handle)
+{
+	struct pollfd fds[2];
+	int* pipes[2];
+	silk_dstr* outputs[2];
+	silk_bool both_open = silk_false;
+	int i = 0;
+
+	pipes[0] = &handle->stdout_fd;
+	pipes[1] = &handle->stderr_fd;
+	outputs[0] = &handle->stdout_string;
+	outputs[1] = &handle->stderr_string;
+
+	while (*pipes[0] != -1 || *pipes[1] != -1)
+	{
+		/* A single pipe is read without waiting for it first */
+		both_open = *pipes[0] != -1 && *pipes[1] != -1;
+		if (both_open)
+		{
+			for (i = 0; i < 2; ++i)
+			{
+				fds[i].fd = *pipes[i];
+				fds[i].events = POLLIN;
+				fds[i].revents = 0;
+			}
+			if (poll(fds, 2, -1) < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				silk_log_error("Could not wait for the output of the command: %s", strerror(errno));
+				return;
+			}
+		}
+
+		for (i = 0; i < 2; ++i)
+		{
+			if (*pipes[i] != -1 && (!both_open || fds[i].revents != 0))
+			{
+				silk_read_pipe(pipes[i], outputs[i]);
+			}
+		}
+	}
+}
+
+/* Called in the fork, before exec. */
+SILK_INTERNAL silk_bool
+silk_set_limit(int resource, silk_size value, const char* name)
+{
+	struct rlimit limit;
+	limit.rlim_cur = (rlim_t)value;
+	limit.rlim_max = (rlim_t)value;
+	if (setrlimit(resource, &limit) < 0)
+	{
+		silk_log_error("Could not limit the %s of the command to %lu: %s", name, (unsigned long)value, strerror(errno));
+		return silk_false;
+	}
+	return silk_true;
+}
+
+SILK_INTERNAL pid_t
+silk_fork_process(char* args[], silk_process_handle* handle, int stdout_pfd[2], int stderr_pfd[2])
+{
+	char** env = silk_jobserver_environment(handle->env);
+	pid_t pid = fork();
+
+	switch (pid)
+	{
+	case -1: /* Error */
+		silk_log_error("Could not fork child process: %s", strerror(errno));
+		return SILK_INVALID_PROCESS;
+	case 0:  /* Child process */
+	{
+		if (handle->own_group)
+		{
+			setpgid(0, 0);
+		}
+		if (handle->memory_limit > 0 && !silk_set_limit(RLIMIT_AS, handle->memory_limit, "address space"))
+		{
+			_exit(127);
+		}
+		if (handle->cpu_limit > 0 && !silk_set_limit(RLIMIT_CPU, handle->cpu_limit, "CPU time"))
+		{
+			_exit(127);
+		}
+
+		if (handle->stdout_to_string)
+		{
+			dup2(stdout_pfd[1], STDOUT_FILENO);
+		}
+		if (handle->stdout_to_string && handle->merge_stderr)
+		{
+			dup2(stdout_pfd[1], STDERR_FILENO);
+		}
+		else if (handle->stderr_to_string)
+		{
+			dup2(stderr_pfd[1], STDERR_FILENO);
+		}
+
+		/* Change directory in the fork */
+		if (handle->starting_directory
+			&& handle->starting_directory[0]
+			&& chdir(handle->starting_directory) < 0) {
+			silk_log_error("Could not change directory to '%s': %s", handle->starting_directory, strerror(errno));
+			_exit(127); /* The fork must not go back to the caller */
+		}
+		environ = env;
+		if (execvp(args[0], args) == SILK_INVALID_PROCESS) {
+			silk_log_error("Could not exec child process: %s", strerror(errno));
+			_exit(127);
+		}
+		SILK_ASSERT(0 && "unreachable");
+		break;
+	}
+	default:
+		/* Also set by the parent, the group must exist when the parent signals it */
+		if (handle->own_group)
+		{
+			setpgid(pid, pid);
+		}
+		break;
+	}
+
+	return pid;
+}
+
+/* glibc 2.29 added the chdir file action, without it the commands started in a directory are forked. */
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))
+#define SILK_SPAWN_CHDIR
+#ifndef __USE_GNU /* Only declared with _GNU_SOURCE, always exported */
+extern int posix_spawn_file_actions_addchdir_np(posix_spawn_file_actions_t* file_actions, const char* path);
+#endif
+#endif
+
+/* Start the process without copying the page tables of silk (glibc spawns with CLONE_VM|CLONE_VFORK),
+   a fork gets slower as the heap and the tmp buffers of the workers grow. */
+SILK_INTERNAL pid_t
+silk_spawn_process(char* args[], silk_process_handle* handle, int stdout_pfd[2], int stderr_pfd[2])
+{
+	posix_spawn_file_actions_t file_actions;
+	posix_spawnattr_t attributes;
+	pid_t pid = SILK_INVALID_PROCESS;
+	short flags = 0;
+	int error = 0;
+	silk_bool in_directory = handle->starting_directory && handle->starting_directory[0];
+
+	if (args == NULL || args[0] == NULL)
+	{
+		silk_log_error("Could not start child process: empty command");
+		return SILK_INVALID_PROCESS;
+	}
+
+	if (silk_process_fork_enabled)
+	{
+		return silk_fork_process(args, handle, stdout_pfd, stderr_pfd);
+	}
+#ifndef SILK_SPAWN_CHDIR
+	if (in_directory)
+	{
+		return silk_fork_process(args, handle, stdout_pfd, stderr_pfd);
+	}
+#endif
+	/* There is no file action for setrlimit */
+	if (handle->memory_limit > 0 || handle->cpu_limit > 0)
+	{
+		return silk_fork_process(args, handle, stdout_pfd, stderr_pfd);
+	}
+
+	posix_spawn_file_actions_init(&file_actions);
+	posix_spawnattr_init(&attributes);
+#ifdef POSIX_SPAWN_USEVFORK
+	flags |= POSIX_SPAWN_USEVFORK; /* Older glibc forks unless asked */
+#endif
+	if (handle->own_group)
+	{
+		flags |= POSIX_SPAWN_SETPGROUP;
+		posix_spawnattr_setpgroup(&attributes, 0);
+	}
+	posix_spawnattr_setflags(&attributes, flags);
+
+	/* The pipes are close-on-exec, their copies on stdout and stderr are not */
+	if (handle->stdout_to_string)
+	{
+		posix_spawn_file_actions_adddup2(&file_actions, stdout_pfd[1], STDOUT_FILENO);
+	}
+	if (handle->stdout_to_string && handle->merge_stderr)
+	{
+		posix_spawn_file_actions_adddup2(&file_actions, stdout_pfd[1], STDERR_FILENO);
+	}
+	else if (handle->stderr_to_string)
+	{
+		posix_spawn_file_actions_adddup2(&file_actions, stderr_pfd[1], STDERR_FILENO);
+	}
+
+#ifdef SILK_SPAWN_CHDIR
+	if (in_directory)
+	{
+		posix_spawn_file_actions_addchdir_np(&file_actions, handle->starting_directory);
+	}
+#endif
+
+	/* Failures of the file actions and of exec are returned here instead of exiting the child with 127 */
+	error = posix_spawnp(&pid, args[0], &file_actions, &attributes, args, silk_jobserver_environment(handle->env));
+	if (error != 0)
+	{
+		if (in_directory)
+		{
+			silk_log_error("Could not start child process '%s' in directory '%s': %s", args[0], handle->starting_directory, strerror(error));
+		}
+		else
+		{
+			silk_log_error("Could not start child process '%s': %s", args[0], strerror(error));
+		}
+		pid = SILK_INVALID_PROCESS;
+	}
+
+	posix_spawnattr_destroy(&attributes);
+	posix_spawn_file_actions_destroy(&file_actions);
+
+	return pid;
+}
+
+/* Start the process of the handle, its outputs are read from handle->stdout_fd and handle->stderr_fd. */
+SILK_INTERNAL silk_bool
+silk_process_launch(silk_process_handle* handle)
+{
+	const char** args = NULL;
+	silk_bool launched = silk_false;
+	int i = 0;
+
+	int stdout_pfd[2] = { -1, -1 }; /* Pipe file descriptor for stdout. */
+	int stderr_pfd[2] = { -1, -1 }; /* Pipe file descriptor for stderr. */
+
+	handle->start_time = silk_time_ms();
+
+	if (silk_debug_enabled)
+	{
+		silk_log_debug("Running process '%s'", silk_process_command(handle));
+	}
+	if (handle->starting_directory && handle->starting_directory[0])
+	{
+		silk_log_debug("Subprocess started in directory '%s'", handle->starting_directory);
+	}
+
+	/* Ensure that everything is written into the outputs before creating a new process that will also write in those outputs */
+	fflush(stdout);
+	fflush(stderr);
+
+	/* Arguments given as is are not copied */
+	args = handle->argv ? (const char**)handle->argv : silk_tmp_split_args(handle->cmd);
+
+	/* Pipes and fork are serialized so a child never inherits the pipes created for another child,
+	   that child would keep them open and the reads below would only end when it exits. */
+	pthread_mutex_lock(&silk_fork_mutex);
+
+	if (handle->stdout_to_string)
+	{
+		if (pipe(stdout_pfd) == -1)
+		{
+			silk_log_error("Pipe creation failed for stdout_pfd.");
+			pthread_mutex_unlock(&silk_fork_mutex);
+			goto cleanup;
+		}
+		fcntl(stdout_pfd[0], F_SETFD, FD_CLOEXEC);
+		fcntl(stdout_pfd[1], F_SETFD, FD_CLOEXEC);
+	}
+	if (handle->stderr_to_string && !(handle->stdout_to_string && handle->merge_stderr))
+	{
+		if (pipe(stderr_pfd) == -1)
+		{
+			silk_log_error("Pipe creation failed for stderr_pfd.");
+			pthread_mutex_unlock(&silk_fork_mutex);
+			goto cleanup;
+		}
+		fcntl(stderr_pfd[0], F_SETFD, FD_CLOEXEC);
+		fcntl(stderr_pfd[1], F_SETFD, FD_CLOEXEC);
+	}
+
+	handle->pid = silk_spawn_process((char**)args, handle, stdout_pfd, stderr_pfd);
+	launched = handle->pid != SILK_INVALID_PROCESS;
+
+	for (i = 0; launched && handle->own_group && i < SILK_MAX_PROCESS_GROUPS; ++i)
+	{
+		if (silk_process_groups[i] == 0)
+		{
+			silk_process_groups[i] = handle->pid;
+			handle->group_slot = i;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&silk_fork_mutex);
+
+cleanup:
+	/* Close the write pipes, only the child process writes into them. */
+	if (stdout_pfd[1] != -1)
+	{
+		close(stdout_pfd[1]);
+	}
+	if (stderr_pfd[1] != -1)
+	{
+		close(stderr_pfd[1]);
+	}
+
+	handle->stdout_fd = stdout_pfd[0];
+	handle->stderr_fd = stderr_pfd[0];
+
+	return launched;
+}
+
+/* Exit code of the process from its wait status, -1 if it failed. */
+SILK_INTERNAL int
+silk_process_exit_status(silk_process_handle* handle, int wstatus)
+{
+	if (WIFEXITED(wstatus)) {
+		if (WEXITSTATUS(wstatus) != 0) {
+			if (!handle->quiet) {
+				silk_log_error("Command exited with exit code '%d'", WEXITSTATUS(wstatus));
+			}
+			return -1;
+		}
+		return 0;
+	}
+
+	if (WIFSIGNALED(wstatus)) {
+		silk_log_error("Command process was terminated by '%s'", strsignal(WTERMSIG(wstatus)));
+	}
+	return -1;
+}
+
+/* Release what is left of the process once it's over. */
+SILK_INTERNAL void
+silk_process_close(silk_process_handle* handle, int exit_status)
+{
+	if (handle->stdout_fd != -1)
+	{
+		close(handle->stdout_fd);
+		handle->stdout_fd = -1;
+	}
+	if (handle->stderr_fd != -1)
+	{
+		close(handle->stderr_fd);
+		handle->stderr_fd = -1;
+	}
+	if (handle->pidfd != -1)
+	{
+		close(handle->pidfd);
+		handle->pidfd = -1;
+	}
+	if (handle->group_slot != -1)
+	{
+		pthread_mutex_lock(&silk_fork_mutex);
+		silk_process_groups[handle->group_slot] = 0;
+		pthread_mutex_unlock(&silk_fork_mutex);
+		handle->group_slot = -1;
+	}
+
+	handle->running = silk_false;
+	handle->exit_code = exit_status;
+	handle->duration = silk_time_ms() - handle->start_time;
+}
+
+SILK_INTERNAL silk_process_handle*
+silk_process_run_core(silk_process_handle* handle)
+{
+	int wstatus = 0; /* pid wait status */
+	int exit_status = -1;
+
+	if (!silk_process_launch(handle))
+	{
+		silk_set_and_goto(exit_status, -1, cleanup);
+	}
+
+	/* Read the outputs before waiting, the child process blocks when a pipe is full. */
+	silk_read_pipes(handle);
+
+	/* wait for process to be done */
+	for (;;) {
+		if (waitpid(handle->pid, &wstatus, 0) < 0) {
+			silk_log_error("Could not wait on command (pid %d): '%s'", handle->pid, strerror(errno));
+			silk_set_and_goto(exit_status, -1, cleanup);
+		}
+
+		if (WIFEXITED(wstatus) || WIFSIGNALED(wstatus)) {
+			exit_status = silk_process_exit_status(handle, wstatus);
+			break; /* Get out of the loop since the process exited. */
+		}
+	}
+
+cleanup:
+	silk_process_close(handle, exit_status);
+	return handle;
+}
+
+SILK_INTERNAL void
+silk_process_kill(silk_process_handle* handle, silk_bool force)
+{
+	/* The processes started by the command are in its group */
+	kill(handle->own_group ? -handle->pid : handle->pid, force ? SIGKILL : SIGTERM);
+}
+
+/* Processes without a pidfd whose pipes are closed are checked at this interval (milliseconds). */
+#define SILK_PROCESS_REAP_INTERVAL 10
+
+SILK_INTERNAL void
+silk_process_start_core(silk_process_handle* handle)
+{
+	if (!silk_process_launch(handle))
+	{
+		silk_process_close(handle, -1);
+		return;
+	}
+
+	handle->running = silk_true;
+#if defined(__linux__) && defined(SYS_pidfd_open)
+	/* Linux 5.3, -1 on older kernels. Always close-on-exec. */
+	handle->pidfd = (int)syscall(SYS_pidfd_open, handle->pid, 0);
+#endif
+}
+
+/* Reap the process if it exited, without blocking. */
+SILK_INTERNAL void
+silk_process_try_reap(silk_process_handle* handle)
+{
+	pid_t pid = waitpid(handle->pid, &handle->wait_status, WNOHANG);
+	if (pid == handle->pid)
+	{
+		handle->reaped = silk_true;
+	}
+	else if (pid < 0 && errno != EINTR)
+	{
+		silk_log_error("Could not wait on command (pid %d): '%s'", handle->pid, strerror(errno));
+		silk_process_close(handle, -1);
+	}
+}
+
+SILK_INTERNAL void
+silk_process_update(silk_process_handle** handles, silk_size count, int timeout_ms)
+{
+	silk_size tmp_index = silk_tmp_save();
+	/* At most two pipes and a pidfd per process */
+	struct pollfd* fds = (struct pollfd*)silk_tmp_alloc(3 * count * sizeof(struct pollfd));
+	silk_process_handle** owners = (silk_process_handle**)silk_tmp_alloc(3 * count * sizeof(silk_process_handle*));
+	int** pipes = (int**)silk_tmp_alloc(3 * count * sizeof(int*)); /* NULL for a pidfd */
+	silk_dstr** outputs = (silk_dstr**)silk_tmp_alloc(3 * count * sizeof(silk_dstr*));
+	silk_size fd_count = 0;
+	silk_process_handle* handle = NULL;
+	double now = silk_time_ms();
+	silk_size i = 0;
+
+	for (i = 0; i < count; ++i)
+	{
+		handle = handles[i];
+		if (handle == NULL || !handle->running)
+		{
+			continue;
+		}
+
+		if (!handle->reaped)
+		{
+			silk_process_check_deadline(handle, now, &timeout_ms);
+		}
+
+		if (!handle->reaped && handle->pidfd == -1 && handle->stdout_fd == -1 && handle->stderr_fd == -1)
+		{
+			/* Nothing tells when it exits */
+			silk_process_try_reap(handle);
+			if (handle->running && !handle->reaped && (timeout_ms < 0 || timeout_ms > SILK_PROCESS_REAP_INTERVAL))
+			{
+				timeout_ms = SILK_PROCESS_REAP_INTERVAL;
+			}
+		}
+
+		if (handle->running && handle->reaped && (handle->timed_out || (handle->stdout_fd == -1 && handle->stderr_fd == -1)))
+		{
+			timeout_ms = 0; /* Over, don't wait for the others */
+			continue;
+		}
+
+		if (handle->running && handle->stdout_fd != -1)
+		{
+			fds[fd_count].fd = handle->stdout_fd;
+			owners[fd_count] = handle;
+			pipes[fd_count] = &handle->stdout_fd;
+			outputs[fd_count++] = &handle->stdout_string;
+		}
+		if (handle->running && handle->stderr_fd != -1)
+		{
+			fds[fd_count].fd = handle->stderr_fd;
+			owners[fd_count] = handle;
+			pipes[fd_count] = &handle->stderr_fd;
+			outputs[fd_count++] = &handle->stderr_string;
+		}
+		if (handle->running && !handle->reaped && handle->pidfd != -1)
+		{
+			fds[fd_count].fd = handle->pidfd;
+			owners[fd_count] = handle;
+			pipes[fd_count] = NULL;
+			outputs[fd_count++] = NULL;
+		}
+	}
+
+	for (i = 0; i < fd_count; ++i)
+	{
+		fds[i].events = POLLIN;
+		fds[i].revents = 0;
+	}
+
+	if (poll(fds, (nfds_t)fd_count, timeout_ms) < 0 && errno != EINTR)
+	{
+		silk_log_error("Could not wait for the commands: %s", strerror(errno));
+	}
+
+	for (i = 0; i < fd_count; ++i)
+	{
+		if (fds[i].revents == 0 || !owners[i]->running)
+		{
+			continue;
+		}
+
+		if (pipes[i] != NULL)
+		{
+			silk_read_pipe(pipes[i], outputs[i]);
+		}
+		else
+		{
+			silk_process_try_reap(owners[i]);
+		}
+	}
+
+	/* The output is complete once the pipes are closed, the processes left by a command that timed out are not waited for */
+	for (i = 0; i < count; ++i)
+	{
+		handle = handles[i];
+		if (handle != NULL && handle->running && handle->reaped && (handle->timed_out || (handle->stdout_fd == -1 && handle->stderr_fd == -1)))
+		{
+			silk_process_close(handle, handle->timed_out ? -1 : silk_process_exit_status(handle, handle->wait_status));
+		}
+	}
+
+	silk_tmp_restore(tmp_index);
+}
+
+#endif
+
+/*-----------------------------------------------------------------------*/
+/* silk_action - commands run concurrently by a pool of workers */
+/*-----------------------------------------------------------------------*/
+
+typedef struct silk_action silk_action;
+
+/* Custom way to run an action, returns the exit code. */
+typedef int (*silk_action_run_fn_t)(silk_action* action);
+
+struct silk_action {
+	const char* cmd;       /* Command to run. */
+	const char* directory; /* Starting directory of the command. */
+	const char* input;     /* Main input of the command (source file, etc.), can be NULL. */
+	const char* output;    /* File created by the command, can be NULL. */
+	int exit_code;         /* -1 until the command has been run. */
+	silk_action_run_fn_t run; /* The command is run as is when NULL. */
+	const void* user_data;    /* Given to 'run' through the action. */
+	double expected_duration; /* Milliseconds, the longest actions are started first. 0 if unknown. */
+	double duration;          /* Milliseconds spent running the command. */
+};
+
+typedef struct silk_action_pool silk_action_pool;
+struct silk_action_pool {
+	silk_action* actions;
+	silk_size* order; /* Indices of the actions, in the order they are started. */
+	silk_size count;
+	silk_size next;   /* Position of the next action to start in 'order'. */
+	silk_bool failed; /* No new action is started once one of them failed. */
+	silk_mutex mutex;
+};
+
+SILK_INTERNAL void
+silk_action_pool_worker(void* user_data)
+{
+	silk_action_pool* pool = (silk_action_pool*)user_data;
+	silk_action* action = NULL;
+	silk_size tmp_index = 0;
+	double start_time = 0;
+
+	for (;;)
+	{
+		silk_mutex_lock(&pool->mutex);
+		action = (!pool->failed && pool->next < pool->count) ? &pool->actions[pool->order[pool->next++]] : NULL;
+		silk_mutex_unlock(&pool->mutex);
+
+		if (!action)
+		{
+			break;
+		}
+
+		/* The temporary buffer is local to each thread, nothing allocated by the process needs to be kept. */
+		tmp_index = silk_tmp_save();
+		silk_job_acquire();
+		start_time = silk_time_ms();
+		action->exit_code = action->run
+			? action->run(action)
+			: silk_process_in_directory_core(silk_create_process_handle(action->cmd, action->directory), silk_true);
+		action->duration = silk_time_ms() - start_time;
+		silk_job_release();
+		silk_trace_add("compile", action->input ? action->input : action->cmd, start_time, action->cmd, action->output, action->exit_code);
+		silk_tmp_restore(tmp_index);
+
+		if (action->exit_code != 0)
+		{
+			silk_mutex_lock(&pool->mutex);
+			pool->failed = silk_true;
+			silk_mutex_unlock(&pool->mutex);
+		}
+	}
+}
+
+typedef struct silk_action_order silk_action_order;
+struct silk_action_order {
+	double expected_duration;
+	silk_size index;
+};
+
+/* Longest expected duration first, in the order of the array otherwise. */
+SILK_INTERNAL int
+silk_action_order_compare(const void* left, const void* right)
+{
+	const silk_action_order* l = (const silk_action_order*)left;
+	const silk_action_order* r = (const silk_action_order*)right;
+
+	if (l->expected_duration != r->expected_duration)
+	{
+		return l->expected_duration > r->expected_duration ? -1 : 1;
+	}
+	return l->index < r->index ? -1 : (l->index > r->index ? 1 : 0);
+}
+
+/* Run all actions using up to silk_get_job_count() processes at the same time.
+   The actions expected to be the longest are started first so they don't end the build alone.
+   Returns true if all the actions succeeded. */
+SILK_INTERNAL silk_bool
+silk_run_actions(silk_action* actions, silk_size count)
+{
+	silk_action_pool pool;
+	silk_action_order* order = NULL;
+	silk_thread* threads = NULL;
+	silk_size thread_count = 0;
+	silk_size worker_count = silk_get_job_count();
+	silk_size i = 0;
+
+	memset(&pool, 0, sizeof(silk_action_pool));
+	pool.actions = actions;
+	pool.order = (silk_size*)SILK_MALLOC((count + 1) * sizeof(silk_size));
+	SILK_ASSERT(pool.order);
+	pool.count = count;
+	silk_mutex_init(&pool.mutex);
+
+	order = (silk_action_order*)SILK_MALLOC((count + 1) * sizeof(silk_action_order));
+	SILK_ASSERT(order);
+	for (i = 0; i < count; ++i)
+	{
+		actions[i].exit_code = -1;
+		actions[i].duration = 0;
+		order[i].expected_duration = actions[i].expected_duration;
+		order[i].index = i;
+	}
+
+	qsort(order, count, sizeof(silk_action_order), silk_action_order_compare);
+	for (i = 0; i < count; ++i)
+	{
+		pool.order[i] = order[i].index;
+	}
+	SILK_FREE(order);
+
+	worker_count = worker_count < count ? worker_count : count;
+
+	/* The calling thread is also a worker so we only need to start the other ones. */
+	if (worker_count > 1)
+	{
+		threads = (silk_thread*)SILK_MALLOC((worker_count - 1) * sizeof(silk_thread));
+		SILK_ASSERT(threads);
+
+		for (i = 0; i < worker_count - 1; ++i)
+		{
+			if (!silk_thread_start(&threads[thread_count], silk_action_pool_worker, &pool))
+			{
+				silk_log_warning("Could not start worker thread, running with %d worker(s).", (int)thread_count + 1);
+				break;
+			}
+			thread_count += 1;
+		}
+	}
+
+	silk_action_pool_worker(&pool);
+
+	for (i = 0; i < thread_count; ++i)
+	{
+		silk_thread_join(&threads[i]);
+	}
+
+	if (threads)
+	{
+		SILK_FREE(threads);
+	}
+
+	silk_mutex_destroy(&pool.mutex);
+	SILK_FREE(pool.order);
+
+	return !pool.failed;
+}
+
+/* Set the expected duration of the actions from their last duration. Actions without history are
+   estimated from the size of their input, scaled by the actions with history if there are some.
+   Returns false if none of them has history, the durations only give an order then. */
+SILK_INTERNAL silk_bool
+silk_actions_expect_durations(silk_action* actions, silk_size count, const silk_db* db)
+{
+	double known_ms = 0;
+	double known_size = 0;
+	double ms_per_byte = 1;
+	silk_size size = 0;
+	silk_size i = 0;
+
+	for (i = 0; i < count; ++i)
+	{
+		actions[i].expected_duration = 0;
+		if (actions[i].output && silk_db_get_duration(db, actions[i].output, &actions[i].expected_duration)
+			&& actions[i].input && silk_file_size(actions[i].input, &size))
+		{
+			known_ms += actions[i].expected_duration;
+			known_size += (double)size;
+		}
+	}
+
+	if (known_ms > 0 && known_size > 0)
+	{
+		ms_per_byte = known_ms / known_size;
+	}
+
+	for (i = 0; i < count; ++i)
+	{
+		if (actions[i].expected_duration == 0 && actions[i].input && silk_file_size(actions[i].input, &size))
+		{
+			actions[i].expected_duration = (double)size * ms_per_byte;
+		}
+	}
+
+	return known_ms > 0 && known_size > 0;
+}
+
+#ifdef _WIN32
+
+/* ================================================================ */
+/* toolchain MSVC */
+/* ================================================================ */
+
+/* #msvc #toolchain */
+
+SILK_API const char*
+silk_toolchain_msvc_bake(silk_toolchain* tc, const char* project_name)
+{
+	silk_dstr str; /* cl.exe command */
+	/* @FIXME use an array of string instead to make it straigthforward to follow */
+	silk_dstr str_obj; /* to keep track of the .obj generated and copy them.*/
+	const char* output_dir;       /* Output directory. Contains the directory path of the binary being created. */
+	
+	silk_kv_range range = { 0 };
+	silk_kv_range lflag_range = { 0 };
+	silk_kv current = { 0 };       /* Temporary kv to store results. */
+	silk_kv current_lflag = { 0 }; /* Temporary kv to linker flags. */
+	silk_strv basename = { 0 };
+	const char* artefact = NULL; /* Resulting artefact path */
+	const char* ext = "";        /* Resulting artefact extension */
+	const char* _ = "  ";        /* Space to separate command arguments. */
+	const char* tmp = "";
+	
+	silk_strv linked_project_name = { 0 };
+	silk_project_t* linked_project = NULL;
+	const char* linked_output_dir; /* to keep track of the .obj generated */
+	const char* path_prefix = NULL;
+	silk_project_t* project = NULL;
+	silk_size tmp_index;
+	project = silk_find_project_by_name_str(project_name);
+
+	if (!project)
+	{
+		return NULL;
+	}
+	
+	silk_dstr_init(&str);
+	silk_dstr_init(&str_obj);
+
+	/* Get and format output directory */
+	output_dir = silk_get_output_directory(project, tc);
+
+	/* Create output directory if it does not exist yet. */
+	silk_create_directories(output_dir, strlen(output_dir));
+
+	/* Use /utf-8 by default since it's retrocompatible with utf-8 */
+	/* Use /nologo to avoid undesirable messages in the command line. */
+	silk_dstr_append_str(&str, "cl.exe /utf-8 /nologo ");
+
+	/* Handle binary type */
+
+	silk_bool is_exe = silk_property_equals(project, silk_BINARY_TYPE, silk_EXE);
+	silk_bool is_shared_library = silk_property_equals(project, silk_BINARY_TYPE, silk_SHARED_LIBRARY);
+	silk_bool is_static_library = silk_property_equals(project, silk_BINARY_TYPE, silk_STATIC_LIBRARY);
+
+	if (!is_exe && !is_shared_library && !is_static_library)
+	{
+		silk_log_error("Unknown binary type");
+		silk_set_and_goto(artefact, NULL, exit);
+	}
+
+	if (is_static_library) {
+		silk_dstr_append_str(&str, "/c ");
+	}
+	else if (is_shared_library) {
+		silk_dstr_append_str(&str, "/LD ");
+	}
+
+	/* Add output directory to cl.exe command */
+	/* /Fo"output/directory/" */
+	silk_dstr_append_f(&str, "/Fo\"%s\" ", output_dir);
+
+	ext = is_exe ? ".exe" : ext;
+	ext = is_static_library ? ".lib" : ext;
+	ext = is_shared_library ? ".dll" : ext;
+
+	artefact = silk_tmp_sprintf("%s%s%s", output_dir, project_name, ext);
+
+	/* Define binary output for executable and shared library. Static library is set with the link.exe command*/
+	if (is_exe || is_shared_library)
+	{
+		/* /Fe"output/directory/bin.ext" */
+		silk_dstr_append_f(&str, "/Fe\"%s\" ", artefact);
+	}
+
+	/* Append compiler flags */
+	{
+		range = silk_mmap_get_range_str(&project->mmap, silk_CXFLAGS);
+		while (silk_mmap_range_get_next(&range, &current))
+		{
+			silk_dstr_append_f(&str,"%s ", current.u.strv.data);
+		}
+	}
+
+	/* Append include directories */
+	{
+		range = silk_mmap_get_range_str(&project->mmap, silk_INCLUDE_DIRECTORIES);
+		while (silk_mmap_range_get_next(&range, &current))
+		{
+			/* Absolute file is created using the tmp buffer allocator but we don't need it once it's inserted into the dynamic string */
+			tmp_index = silk_tmp_save();
+			silk_dstr_append_f(&str, "/I\"%s\" ", silk_path_get_absolute_dir(current.u.strv.data));
+			silk_tmp_restore(tmp_index);
+		}
+	}
+	
+	/* Append preprocessor definition */
+	{
+		range = silk_mmap_get_range_str(&project->mmap, silk_DEFINES);
+		while (silk_mmap_range_get_next(&range, &current))
+		{
+			silk_dstr_append_f(&str, "/D\"%s\" ", current.u.strv.data);
+		}
+	}
+
+	/* Append files and .obj */
+	{
+		range = silk_mmap_get_range_str(&project->mmap, silk_FILES);
+		while (silk_mmap_range_get_next(&range, &current))
+		{
+			/* Absolute file is created using the tmp buffer allocator but we don't need it once it's inserted into the dynamic string */
+			tmp_index = silk_tmp_save();
+
+			silk_dstr_append_f(&str, "\"%s\" ", silk_path_get_absolute_file(current.u.strv.data));
+
+			silk_tmp_restore(tmp_index);
+
+			basename = silk_path_basename(current.u.strv);
+
+			silk_dstr_append_f(&str_obj, "\"%.*s.obj\" ", basename.size, basename.data);
+		}
+	}
+
+	/* Append libraries */
+	{
+		range = silk_mmap_get_range_str(&project->mmap, silk_LIBRARIES);
+		while (silk_mmap_range_get_next(&range, &current))
+		{
+			silk_dstr_append_f(&str, "\"%s.lib\" ", current.u.strv.data);
+		}
+	}
+
+	/* For each linked project we add the link information to the cl.exe command */
+	range = silk_mmap_get_range_str(&project->mmap, silk_LINK_PROJECTS);
+	if (range.count > 0)
+	{
+		silk_dstr_append_str(&str, "/link ");
+		/* Add linker flags */
+		{
+			lflag_range = silk_mmap_get_range_str(&project->mmap, silk_LFLAGS);
+			while (silk_mmap_range_get_next(&lflag_range, &current_lflag))
+			{
+				silk_dstr_append_strv(&str, current_lflag.u.strv);
+				silk_dstr_append_str(&str, _);
+			}
+		}
+
+		/* iterate all the linked projects */
+		while (silk_mmap_range_get_next(&range, &current))
+		{
+			linked_project_name = current.u.strv;
+
+			linked_project = silk_find_project_by_name(linked_project_name);
+			if (!project)
+			{
+				silk_set_and_goto(artefact, NULL, exit);
+			}
+
+			linked_output_dir = silk_get_output_directory(linked_project, tc);
+
+			/* is shared or static library */
+			if (silk_property_equals(linked_project, silk_BINARY_TYPE, silk_SHARED_LIBRARY)
+				|| silk_property_equals(linked_project, silk_BINARY_TYPE, silk_STATIC_LIBRARY))
+			{
+				/* /LIBPATH:"output/dir/" "mlib.lib" */
+				silk_dstr_append_f(&str, "/LIBPATH:\"%s\" \"%.*s.lib\" ", linked_output_dir, linked_project_name.size, linked_project_name.data);
+			}
+
+			/* is shared library */
+			if (silk_property_equals(linked_project, silk_BINARY_TYPE, silk_SHARED_LIBRARY))
+			{
+				path_prefix = silk_tmp_sprintf("%s%.*s", linked_output_dir, linked_project_name.size, linked_project_name.data);
+				/* .dll */
+				tmp = silk_tmp_sprintf("%s.dll", path_prefix);
+				if (!silk_copy_file_to_dir(tmp, output_dir))
+				{
+					silk_set_and_goto(artefact, NULL, exit);
+				}
+
+				/* .exp */
+				tmp = silk_tmp_sprintf("%s.exp", path_prefix);
+				if (!silk_copy_file_to_dir(tmp, output_dir))
+				{
+					silk_log_warning("Missing .exp. Shared libraries usually need to have some symbol exported with '__declspec(dllexport)'");
+					silk_set_and_goto(artefact, NULL, exit);
+				}
+
+				/* .lib */
+				tmp = silk_tmp_sprintf("%s.lib", path_prefix);
+				if (!silk_copy_file_to_dir(tmp, output_dir))
+				{
+					silk_log_warning("Missing .lib file. Shared libraries must create a .lib file for other program to be linked with at compile time.");
+					silk_set_and_goto(artefact, NULL, exit);
+				}
+
+				/* Copy .pdb if there is any. */
+				tmp = silk_tmp_sprintf("%s.pdb", path_prefix);
+				silk_try_copy_file_to_dir(tmp, output_dir);
+			}
+		}
+	}
+
+	/* execute cl.exe */
+	if (silk_process_in_directory(str.data, output_dir) != 0)
+	{
+		silk_set_and_goto(artefact, NULL, exit);
+	}
+	
+	if (is_static_library)
+	{
+		/* lib.exe /NOLOGO /OUT:"output/dir/my_lib.lib" /LIBPATH:"output/dir/" a.obj b.obj c.obj ... */
+		tmp = silk_tmp_sprintf("lib.exe /NOLOGO /OUT:\"%s\"  /LIBPATH:\"%s\" %s ", artefact, output_dir, str_obj.data);
+		if (silk_process_in_directory(tmp, output_dir) != 0)
+		{
+			silk_log_error("Could not execute command to build static library\n");
+			silk_set_and_goto(artefact, NULL, exit);
+		}
+	}
+
+exit:
+	silk_dstr_destroy(&str);
+	silk_dstr_destroy(&str_obj);
+
+	return artefact;
+}
+
+SILK_API silk_toolchain
+silk_toolchain_msvc(void)
+{
+	silk_toolchain tc;
+	tc.bake = silk_toolchain_msvc_bake;
+	tc.name = "msvc";
+	tc.default_directory_base = ".build/msvc";
+	return tc;
+}
+
+#else
+
+/* ================================================================ */
+/* toolchain GCC */
+/* ================================================================ */
+
+/* #gcc #toolchain */
+
+SILK_INTERNAL silk_bool
+silk_strv_ends_with(silk_strv sv, silk_strv rhs)
+{
+	silk_strv sub = { 0 };
+	if (sv.size < rhs.size)
+	{
+		return silk_false;
+	}
+
+	sub = silk_strv_make(sv.data + (sv.size - rhs.size), rhs.size);
+	return silk_strv_equals_strv(sub, rhs);
+}
+
+/* Path of the object built from an absolute source path.
+   The source tree is mirrored in the "obj" directory so files with the same name in different directories do not collide.
+   Sources generated in the output directory (unity files) have their object next to them.
+   Example: "/cwd/src/a/x.c" gives "<output_dir>obj/src/a/x.o", "<output_dir>unity/unity_0.c" gives "<output_dir>unity/unity_0.o" */
+SILK_INTERNAL char*
+silk_gcc_object_path(const char* output_dir, const char* source)
+{
+	char* cwd = (char*)silk_tmp_calloc(FILENAME_MAX);
+	silk_size cwd_len = 0;
+	silk_size output_dir_len = strlen(output_dir);
+	silk_strv relative = silk_strv_make_str(source);
+	const char* prefix = "obj/";
+	silk_size ext_pos = 0;
+	char* object = NULL;
+	char* cursor = NULL;
+
+	/* Sources within the current directory keep their relative path, others keep their absolute path. */
+	if (strncmp(source, output_dir, output_dir_len) == 0)
+	{
+		/* Generated, already in the output directory */
+		relative = silk_strv_make_str(source + output_dir_len);
+		prefix = "";
+	}
+	else if (getcwd(cwd, FILENAME_MAX) != NULL)
+	{
+		cwd_len = strlen(cwd);
+		if (strncmp(source, cwd, cwd_len) == 0 && silk_is_directory_separator(source[cwd_len]))
+		{
+			relative = silk_strv_make_str(source + cwd_len);
+		}
+	}
+
+	while (relative.size > 0 && silk_is_directory_separator(relative.data[0]))
+	{
+		relative = silk_strv_make(relative.data + 1, relative.size - 1);
+	}
+
+	/* Remove extension */
+	ext_pos = silk_rfind(relative, '.');
+	if (ext_pos != SILK_NPOS && ext_pos > silk_rfind2(relative, '/', '\\') + 1)
+	{
+		relative.size = ext_pos;
+	}
+
+	object = (char*)silk_tmp_sprintf("%s%s%.*s.o", output_dir, prefix, (int)relative.size, relative.data);
+
+	/* ".." would go outside of the "obj" directory */
+	cursor = object + strlen(output_dir);
+	while ((cursor = strstr(cursor, "/../")) != NULL)
+	{
+		cursor[1] = '_';
+		cursor[2] = '_';
+	}
+
+	return object;
+}
+
+/* Path of a file stored next to the object, "x.o" with ".d" gives "x.d" */
+SILK_INTERNAL const char*
+silk_gcc_object_companion_path(const char* object, const char* ext)
+{
+	silk_size size = strlen(object) - 2; /* Remove ".o" */
+	return silk_tmp_sprintf("%.*s%s", (int)size, object, ext);
+}
+
+/* Dependency file generated by the compiler with the object */
+SILK_INTERNAL const char*
+silk_gcc_depfile_path(const char* object)
+{
+	return silk_gcc_object_companion_path(object, ".d");
+}
+
+/* Parse a dependency file generated by the compiler with -MMD: "target.o: source.c header\ with\ space.h \\"
+   Each prerequisite is written in 'deps' as a null-terminated string and the number of prerequisites is returned.
+   Targets are skipped, so are the phony rules created with -MP. */
+SILK_INTERNAL silk_size
+silk_depfile_parse(const char* data, silk_size size, silk_dstr* deps)
+{
+	const char* cur = data;
+	const char* end = data + size;
+	char* out = NULL;
+	char* token = NULL;
+	silk_bool is_target = silk_true; /* Rules start with their targets */
+	silk_bool token_is_target = silk_false;
+	silk_size count = 0;
+
+	/* Unescaped paths are never longer than the file, so it's written in place without checking the capacity. */
+	silk_dstr_clear(deps);
+	if (size == 0)
+	{
+		return 0; /* 'deps' may still be the read-only empty string */
+	}
+	if (deps->capacity < size)
+	{
+		silk_dstr_reserve(deps, size);
+	}
+	out = deps->data;
+
+	while (cur < end)
+	{
+		/* Skip spaces and escaped new lines */
+		if (*cur == ' ' || *cur == '\t' || *cur == '\r')
+		{
+			cur += 1;
+			continue;
+		}
+		if (*cur == '\\' && cur + 1 < end && (cur[1] == '\n' || cur[1] == '\r'))
+		{
+			cur += 2;
+			continue;
+		}
+		/* New rule */
+		if (*cur == '\n')
+		{
+			is_target = silk_true;
+			cur += 1;
+			continue;
+		}
+
+		token = out;
+		token_is_target = silk_false;
+		while (cur < end)
+		{
+			if (*cur == '\\' && cur + 1 < end && (cur[1] == ' ' || cur[1] == '#' || cur[1] == '\\'))
+			{
+				*out++ = cur[1];
+				cur += 2;
+			}
+			else if (*cur == '$' && cur + 1 < end && cur[1] == '$')
+			{
+				*out++ = '$';
+				cur += 2;
+			}
+			else if (*cur == ' ' || *cur == '\t' || *cur == '\r' || *cur == '\n'
+				|| (*cur == '\\' && cur + 1 < end && cur[1] == '\n'))
+			{
+				break;
+			}
+			/* Colon followed by a space ends the targets, "C:/" is not a separator. */
+			else if (is_target && *cur == ':' && (cur + 1 == end || cur[1] == ' ' || cur[1] == '\t' || cur[1] == '\r' || cur[1] == '\n'))
+			{
+				cur += 1;
+				is_target = silk_false;
+				token_is_target = silk_true;
+				break;
+			}
+			else
+			{
+				*out++ = *cur++;
+			}
+		}
+
+		if (is_target || token_is_target || out == token)
+		{
+			out = token; /* Discard targets */
+			continue;
+		}
+
+		*out++ = '\0';
+		count += 1;
+	}
+
+	deps->size = out - deps->data;
+	deps->data[deps->size] = '\0';
+	return count;
+}
+
+/* Dependencies of the object (source and headers), null-terminated strings one after the other.
+   They are recorded in the database when the object is compiled, the dependency file is only read when they are not there.
+   The compiler runs in 'directory' (ending with a separator), the relative paths of the dependency file are relative to it.
+   'content' and 'deps' are buffers reused from one call to another. Returns false if there is no dependency file. */
+SILK_INTERNAL silk_bool
+silk_gcc_object_deps(const silk_db* db, const char* directory, const char* object, const char* depfile, silk_dstr* content, silk_dstr* deps, silk_strv* list)
+{
+	const char* dep = NULL;
+	silk_size tmp_index = silk_tmp_save();
+	silk_bool found = db && silk_db_get(db, silk_tmp_sprintf("deps %s", object), list);
+	silk_tmp_restore(tmp_index);
+
+	if (found)
+	{
+		return silk_true;
+	}
 
-		if (handle->stdout_to_string)
-		{
-			/* Create a pipe for the child process's stdout. */
-			if (!CreatePipe(&process_stdout_read, &process_stdout_write, &saAttr, 0)
-				|| !SetHandleInformation(process_stdout_read, HANDLE_FLAG_INHERIT, 0))
-			{
-				silk_log_error("Could not create pipe for stdout.");
-				exit(1);
-			}
+	if (!silk_read_file(depfile, content))
+	{
+		return silk_false;
+	}
 
-			si.hStdOutput = process_stdout_write;
-		}
+	silk_depfile_parse(content->data, content->size, deps);
 
-		if (handle->stderr_to_string)
+	/* Headers found with a relative include directory, they are checked from the directory of silk */
+	for (dep = deps->data; dep < deps->data + deps->size && silk_path_is_absolute(silk_strv_make_str(dep)); dep += strlen(dep) + 1) {}
+	if (dep < deps->data + deps->size)
+	{
+		silk_dstr_assign(content, deps->data, deps->size);
+		silk_dstr_clear(deps);
+		for (dep = content->data; dep < content->data + content->size; dep += strlen(dep) + 1)
 		{
-			/* Create a pipe for the child process's stderr. */
-			if (!CreatePipe(&process_stderr_read, &process_stderr_write, &saAttr, 0)
-				|| !SetHandleInformation(process_stderr_read, HANDLE_FLAG_INHERIT, 0))
+			if (!silk_path_is_absolute(silk_strv_make_str(dep)))
 			{
-				silk_log_error("Could not create pipe for stderr.");
-				exit(1);
+				silk_dstr_append_from(deps, deps->size, directory, strlen(directory));
 			}
-
-			si.hStdError = process_stderr_write;
+			silk_dstr_append_from(deps, deps->size, dep, strlen(dep) + 1);
 		}
 	}
 
-	ZeroMemory(&pi, sizeof(pi));
+	*list = silk_strv_make(deps->data, deps->size);
+	return silk_true;
+}
 
-	/* Start the child process.
-	*  NOTE: we use CreateProcessW because CreateProcessA (with /utf-8) cannot create path with unicode.
-	*/
-	if (!CreateProcessW(
-		NULL,                 /* No module name (use command line) */
-		cmd_w,                /* Command line */
-		NULL,                 /* Process handle not inheritable */
-		NULL,                 /* Thread handle not inheritable */ 
-		handles_inheritance,  /* Set handle inheritance */
-		0,                    /* No creation flags */
-		NULL,                 /* Use parent's environment block */
-		starting_directory_w, /* Use parent's starting directory */
-		&si,                  /* Pointer to STARTUPINFO structure */
-		&pi)                  /* Pointer to PROCESS_INFORMATION structure */
-		)
+/* Returns the reason why the object needs to be compiled or NULL if it is up to date.
+   The modification time of the object is written in 'object_mtime' if it exists.
+   Dependencies of the object are checked as well, so editing a header recompiles the sources including it.
+   'kind' names the object in the reason ("object", "precompiled header").
+   'content' and 'deps' are buffers reused from one call to another. */
+SILK_INTERNAL const char*
+silk_gcc_object_stale_reason(silk_file_cache* mtimes, const silk_db* db, const char* directory, const char* source, const char* object, const char* kind,
+	const char* depfile, silk_dstr* content, silk_dstr* deps, double* object_mtime)
+{
+	double source_mtime = 0;
+	double dep_mtime = 0;
+	const char* dep = NULL;
+	silk_strv list;
+
+	if (!silk_file_mtime(object, object_mtime))
 	{
-		silk_log_error("CreateProcessW failed: %d", GetLastError());
-		/* No need to close handles since the process creation failed */
-		return handle;
+		return silk_tmp_sprintf("%s does not exist", kind);
 	}
 
-	/* Close the write ends of the pipes since they will not be used in the parent process. */
-	
-	if (handle->stdout_to_string)
-		CloseHandle(process_stdout_write);
-	if (handle->stderr_to_string)
-		CloseHandle(process_stderr_write);
-
-	wait_result = WaitForSingleObject(
-		pi.hProcess, /* HANDLE hHandle, */
-		INFINITE     /* DWORD  dwMilliseconds */
-	);
+	/* The compiler will report a missing source */
+	if (!silk_file_cache_mtime(mtimes, source, &source_mtime) || source_mtime > *object_mtime)
+	{
+		return silk_tmp_sprintf("source is newer than the %s", kind);
+	}
 
-	if (wait_result == WAIT_FAILED)
+	if (!silk_gcc_object_deps(db, directory, object, depfile, content, deps, &list))
 	{
-		silk_log_error("Could not wait on child process: %lu", GetLastError());
+		return "dependency file does not exist";
 	}
-	else
+
+	for (dep = list.data; dep < list.data + list.size; dep += strlen(dep) + 1)
 	{
-		if (GetExitCodeProcess(pi.hProcess, &exit_code))
+		/* A removed header is considered as a change, the compiler reports it if it's still included. */
+		if (!silk_file_cache_mtime(mtimes, dep, &dep_mtime))
 		{
-			if (exit_code != 0)
-			{
-				silk_log_error("Command exited with exit code %lu", exit_code);
-			}
+			return silk_tmp_sprintf("'%s' does not exist anymore", dep);
 		}
-		else
+
+		if (dep_mtime > *object_mtime)
 		{
-			silk_log_error("Could not get process exit code: %lu", GetLastError());
+			return silk_tmp_sprintf("'%s' is newer than the %s", dep, kind);
 		}
 	}
 
-	if (handle->stdout_to_string)
+	return NULL;
+}
+
+/* Digest of the compile command and of the content of all the dependencies (source and headers).
+   'content' is a buffer reused from one call to another. Returns false if one of the dependencies could not be read. */
+SILK_INTERNAL silk_bool
+silk_gcc_object_digest(silk_file_cache* files, const char* cmd, silk_strv deps, silk_dstr* content, silk_digest* digest)
+{
+	silk_digest dep_digest;
+	const char* dep = NULL;
+
+	silk_dstr_assign_str(content, cmd);
+	silk_dstr_append_from(content, content->size, "", 1);
+
+	for (dep = deps.data; dep < deps.data + deps.size; dep += strlen(dep) + 1)
 	{
-		/* Read output from the child process's pipe for stdout. Stop when there is no more data. */
-		while (ReadFile(process_stdout_read, process_output_buffer, sizeof(process_output_buffer), &byte_read_from_buffer, NULL)
-			&& byte_read_from_buffer != 0)
+		if (!silk_file_cache_digest(files, dep, &dep_digest))
 		{
-			silk_dstr_append_f(&handle->stdout_string, "%.*s", (int)byte_read_from_buffer, process_output_buffer);
+			return silk_false;
 		}
-		CloseHandle(process_stdout_read);
+
+		silk_dstr_append_from(content, content->size, dep, strlen(dep) + 1);
+		silk_dstr_append_from(content, content->size, (const char*)dep_digest.h, sizeof(dep_digest.h));
+	}
+
+	*digest = silk_digest_make(content->data, content->size, 0);
+	return silk_true;
+}
+
+/* Same as silk_gcc_object_stale_reason but only the content of the files and the command are considered, not their modification time.
+   Useful when all the files are checked out again (on a CI for example). */
+SILK_INTERNAL const char*
+silk_gcc_object_digest_stale_reason(silk_file_cache* files, const silk_db* db, const char* directory, const char* cmd, const char* object, silk_dstr* content, silk_dstr* deps, double* object_mtime)
+{
+	silk_digest digest;
+	silk_strv recorded_digest;
+	silk_strv list;
+	silk_size tmp_index = 0;
+	silk_bool found = silk_false;
+
+	if (!silk_file_mtime(object, object_mtime))
+	{
+		return "object does not exist";
 	}
 
-	if (handle->stderr_to_string)
+	tmp_index = silk_tmp_save();
+	found = silk_db_get(db, silk_tmp_sprintf("hash %s", object), &recorded_digest) && recorded_digest.size == sizeof(digest.h);
+	silk_tmp_restore(tmp_index);
+	if (!found)
 	{
-		while (ReadFile(process_stderr_read, process_output_buffer, sizeof(process_output_buffer), &byte_read_from_buffer, NULL)
-			&& byte_read_from_buffer != 0)
-		{
-			silk_dstr_append_f(&handle->stderr_string, "%.*s", (int)byte_read_from_buffer, process_output_buffer);
-		}
+		return "digest of the object does not exist";
+	}
 
-		CloseHandle(process_stderr_read);
+	if (!silk_gcc_object_deps(db, directory, object, silk_gcc_depfile_path(object), content, deps, &list)
+		|| !silk_gcc_object_digest(files, cmd, list, content, &digest))
+	{
+		return "a dependency could not be read";
 	}
 
-	/* Close process and thread handles. */
-	CloseHandle(pi.hProcess);
-	CloseHandle(pi.hThread);
+	if (memcmp(recorded_digest.data, digest.h, sizeof(digest.h)) != 0)
+	{
+		return "content of the source, a header or the command changed";
+	}
 
-	handle->exit_code = exit_code;
-	return handle;
+	return NULL;
 }
-#else
-
-/* space or tab */
-SILK_INTERNAL silk_bool silk_is_space(char c) { return c == ' ' || c == '\t'; }
 
-SILK_INTERNAL silk_bool
-silk_is_end_of_quote(const char* str, char quote_type)
+/* Record what the next builds need to know about the object once it has been compiled: its dependencies,
+   and the digest of their content with silk_CONTENT_HASH rebuild mode or the fingerprint of the command otherwise. */
+SILK_INTERNAL void
+silk_gcc_record_object(silk_db* db, silk_file_cache* files, const char* directory, const char* cmd, const char* object, silk_bool content_hash, silk_dstr* content, silk_dstr* deps)
 {
-	return *str != '\0'
-		&& *str == quote_type
-		&& (str[1] == '\0' || silk_is_space(str[1]));
+	silk_digest digest;
+	silk_strv list;
 
+	if (!silk_gcc_object_deps(NULL, directory, object, silk_gcc_depfile_path(object), content, deps, &list))
+	{
+		return;
+	}
+	silk_db_put(db, silk_tmp_sprintf("deps %s", object), list.data, list.size);
+
+	if (!content_hash)
+	{
+		silk_record_command_fingerprint(db, object, cmd);
+	}
+	else if (silk_gcc_object_digest(files, cmd, list, content, &digest))
+	{
+		silk_db_put(db, silk_tmp_sprintf("hash %s", object), digest.h, sizeof(digest.h));
+	}
 }
-/* Parse arguments, space is a separator and everything between <space or begining of string><quote> and <quote><space or end of string>
-* Quotes can be double quotes or simple quotes.
-a b c   => 3 arguments a b c
-abc     => 1 argument "abc"
-a "b" c => 3 arguments a b c;
-a"b"c   => 1 argument a"b"c
-"a"b"c" => 1 argument a"b"c
-*/
-SILK_INTERNAL const char*
-silk_get_next_arg(const char* str, silk_strv* sv)
+
+/* Write the arguments of the command in a response file if the command is longer than SILK_MAX_COMMAND_LENGTH.
+   Returns { program, "@response_file" } in this case, the arguments otherwise.
+   Arguments are written one per line, escaped the way gcc and ar read response files. */
+SILK_INTERNAL const char**
+silk_response_file_args(const char** args, const char* response_file)
 {
-	sv->data = str;
-	sv->size = 0;
-	if (str == NULL || *str == '\0')
-		return NULL;
-		
-	while (*str != '\0')
+	silk_dstr content;
+	const char** result = args;
+	const char* arg = NULL;
+	silk_size length = 0;
+	silk_size i = 0;
+
+	for (i = 0; args[i] != NULL; ++i)
 	{
-		/* Skip spaces */
-		while (*str != '\0' && silk_is_space(*str))
-			str += 1;
+		length += strlen(args[i]) + 1;
+	}
 
-		/* Return early if end of string */
-		if (*str == '\0') 
-			return sv->size > 0 ? str: NULL;
+	if (length <= SILK_MAX_COMMAND_LENGTH || args[0] == NULL)
+	{
+		return args;
+	}
 
-		/* Handle quotes */
-		if (*str == '\'' || *str == '\"')
-		{
-			const char* quote = str;
-			str += 1; /* skip quote */
-			
-			/* Return early if end of string */
-			if (*str == '\0')
-				return sv->size > 0 ? str : NULL;
+	silk_dstr_init(&content);
 
-			/* Quote next the previous one so it's an empty content, we look for another item */
-			if (silk_is_end_of_quote(str, *quote))
+	for (i = 1; args[i] != NULL; ++i)
+	{
+		for (arg = args[i]; *arg != '\0'; ++arg)
+		{
+			if (silk_is_space(*arg) || *arg == '\\' || *arg == '"' || *arg == '\'')
 			{
-				str += 1; /* Skip quote */
-				continue;
+				silk_dstr_append_from(&content, content.size, "\\", 1);
 			}
+			silk_dstr_append_from(&content, content.size, arg, 1);
+		}
+		silk_dstr_append_from(&content, content.size, "\n", 1);
+	}
 
-			sv->data = str; /* The next argument will begin right after the quote */
-			/* Skip everything until the next unescaped quote */
-			while (*str != '\0' && !silk_is_end_of_quote(str, *quote))
-				str += 1;
+	if (silk_write_file(response_file, content.data, content.size))
+	{
+		result = (const char**)silk_tmp_alloc(3 * sizeof(const char*));
+		result[0] = args[0];
+		result[1] = silk_tmp_sprintf("@%s", response_file);
+		result[2] = NULL;
+	}
 
-			/* Either it's the end of the quoted string, either we reached the null terminating string */
-			sv->size = (str - quote) - 1;
+	silk_dstr_destroy(&content);
+	return result;
+}
 
-			/* Eat trailing quote so that next argument can start with space */
-			while (*str != '\0' && *str == *quote)
-				str += 1;
+/* Run a command of the toolchain, the arguments are given through 'response_file' if the command is too long. */
+SILK_INTERNAL int
+silk_gcc_process_args(const char** args, const char* directory, const char* response_file)
+{
+	return silk_process_in_directory_core(silk_create_process_handle_argv(silk_response_file_args(args, response_file), directory, NULL), silk_true);
+}
 
-			return str;
-		}
-		else /* is char */
-		{
-			const char* ch = str;
-			while (*str != '\0' && !silk_is_space(*str))
-				str += 1;
+SILK_INTERNAL int
+silk_gcc_process(const char* cmd, const char* directory, const char* response_file)
+{
+	return silk_gcc_process_args(silk_tmp_split_args(cmd), directory, response_file);
+}
 
-			sv->data = ch; /* remove quote */
-			sv->size = str - ch;
-			return str;
-		}
-	}
-	return NULL;
+/* Flags of the compile commands of a project, given to the compile actions through 'user_data'.
+   The arguments of "cc <cflags>" are split once, each command only adds its own arguments. */
+typedef struct silk_gcc_compile_flags silk_gcc_compile_flags;
+struct silk_gcc_compile_flags {
+	const char* cflags;
+	const char** args;
+	silk_size arg_count;
+};
+
+/* Arguments of "cc <cflags> -MMD -MF <depfile> <mode> <input> -o <output>", the depfile is next to the object. */
+SILK_INTERNAL const char**
+silk_gcc_compile_args(const silk_gcc_compile_flags* flags, const char* object, const char* mode, const char* input, const char* output)
+{
+	const char** args = (const char**)silk_tmp_alloc((flags->arg_count + 8) * sizeof(const char*));
+	const char** arg = args + flags->arg_count;
+
+	memcpy(args, flags->args, flags->arg_count * sizeof(const char*));
+	*arg++ = "-MMD";
+	*arg++ = "-MF";
+	*arg++ = silk_gcc_depfile_path(object);
+	*arg++ = mode;
+	*arg++ = input;
+	*arg++ = "-o";
+	*arg++ = output;
+	*arg = NULL;
+
+	return args;
 }
 
-#define SILK_INVALID_PROCESS (-1)
+/* Compile an object, the response file is stored next to it. */
+SILK_INTERNAL int
+silk_gcc_compile(silk_action* action)
+{
+	const silk_gcc_compile_flags* flags = (const silk_gcc_compile_flags*)action->user_data;
+	return silk_gcc_process_args(silk_gcc_compile_args(flags, action->output, "-c", action->input, action->output),
+		action->directory, silk_gcc_object_companion_path(action->output, ".rsp"));
+}
 
-SILK_INTERNAL pid_t
-silk_fork_process(char* args[], silk_process_handle* handle, int stdout_pfd[2], int stderr_pfd[2])
+/* Identity of the compiler, objects compiled by another compiler or another version are not taken from the cache. */
+SILK_INTERNAL silk_digest
+silk_gcc_compiler_digest(void)
 {
-	pid_t pid = fork();
+	static silk_bool known = silk_false;
+	static silk_digest digest;
+	silk_process_handle* handle = NULL;
+	const char* version = NULL;
 
-	switch (pid)
+	silk_mutex_lock(&silk_cache_mutex);
+	if (!known)
 	{
-	case -1: /* Error */
-		silk_log_error("Could not fork child process: %s", strerror(errno));
-		return SILK_INVALID_PROCESS;
-	case 0:  /* Child process */
+		handle = silk_process_to_string("cc --version", NULL, silk_false);
+		version = silk_process_stdout_string(handle);
+		digest = silk_digest_make(version, strlen(version), 0);
+		silk_process_end(handle);
+		known = silk_true;
+	}
+	silk_mutex_unlock(&silk_cache_mutex);
+
+	return digest;
+}
+
+/* Append 'data' to the key of the cache without the root directory of the project, the line markers of the
+   preprocessed source and the include directories are then the same in every checkout. */
+SILK_INTERNAL void
+silk_cache_key_append(silk_dstr* key_content, const char* data, silk_size size, const char* root)
+{
+	silk_size root_size = strlen(root);
+	char* out = silk_dstr_tail_space(key_content, size);
+	const char* cur = data;
+	const char* end = data + size;
+
+	while (cur < end)
 	{
-		if (handle->stdout_to_string)
-		{
-			dup2(stdout_pfd[1], STDOUT_FILENO);
-		}
-		if (handle->stderr_to_string)
+		if (root_size > 0 && *cur == *root && (silk_size)(end - cur) >= root_size && memcmp(cur, root, root_size) == 0)
 		{
-			dup2(stderr_pfd[1], STDERR_FILENO);
+			cur += root_size;
+			continue;
 		}
+		*out++ = *cur++;
+	}
 
-		/* Change directory in the fork */
-		if (handle->starting_directory
-			&& handle->starting_directory[0]
-			&& chdir(handle->starting_directory) < 0) {
-			silk_log_error("Could not change directory to '%s': %s", handle->starting_directory, strerror(errno));
-			return SILK_INVALID_PROCESS;
-		}
-		if (execvp(args[0], args) == SILK_INVALID_PROCESS) {
-			silk_log_error("Could not exec child process: %s", strerror(errno));
-			return SILK_INVALID_PROCESS;
-		}
-		SILK_ASSERT(0 && "unreachable");
-		break;
+	silk_dstr_expand(key_content, out - (key_content->data + key_content->size));
+}
+
+/* Compile an object through the cache, 'user_data' of the action is the flags of the compile command (silk_gcc_compile_flags).
+   The source is preprocessed first, the object is copied from the cache when the same preprocessed source
+   has already been compiled with the same flags and the same compiler. */
+SILK_INTERNAL int
+silk_gcc_cached_compile(silk_action* action)
+{
+	const silk_gcc_compile_flags* flags = (const silk_gcc_compile_flags*)action->user_data;
+	const char* preprocessed = silk_gcc_object_companion_path(action->output, ".i");
+	silk_dstr preprocessed_content;
+	silk_dstr key_content;
+	silk_digest compiler;
+	silk_bool has_key = silk_false;
+	char key[SILK_DIGEST_HEX_SIZE + 1];
+	char* root = (char*)silk_tmp_calloc(FILENAME_MAX + 1);
+	int exit_code = 0;
+
+	/* The dependency file is generated while preprocessing, it's up to date even if the compiler is not run. */
+	/* Example: cc <flags> <includes> -MMD -MF "output/dir/obj/my/file.d" -E "my/file.c" -o "output/dir/obj/my/file.i" */
+	exit_code = silk_gcc_process_args(silk_gcc_compile_args(flags, action->output, "-E", action->input, preprocessed),
+		action->directory, silk_gcc_object_companion_path(action->output, ".rsp"));
+
+	if (exit_code != 0)
+	{
+		return exit_code;
 	}
-	default:
-		/* Do nothing for parent process */
-		break;
+
+	/* Paths are relative to the directory of the silkfile */
+	if (getcwd(root, FILENAME_MAX) != NULL)
+	{
+		strcat(root, "/");
 	}
 
-	return pid;
-}
+	silk_dstr_init(&preprocessed_content);
+	silk_dstr_init(&key_content);
+	if (silk_read_file(preprocessed, &preprocessed_content))
+	{
+		compiler = silk_gcc_compiler_digest();
+		silk_cache_key_append(&key_content, preprocessed_content.data, preprocessed_content.size, root);
+		silk_cache_key_append(&key_content, flags->cflags, strlen(flags->cflags) + 1, root);
+		silk_dstr_append_from(&key_content, key_content.size, (const char*)compiler.h, sizeof(compiler.h));
+		silk_digest_to_hex(silk_digest_make(key_content.data, key_content.size, 0), key);
+		has_key = silk_true;
+	}
+	silk_dstr_destroy(&preprocessed_content);
+	silk_dstr_destroy(&key_content);
+	remove(preprocessed);
 
-SILK_INTERNAL silk_process_handle*
-silk_process_core(silk_process_handle* handle)
-{
-	silk_darrT(const char*) args;
-	silk_strv arg; /* Current argument */
-	const char* cmd_cursor = handle->cmd; /* Current position in the string command */
-	pid_t pid = SILK_INVALID_PROCESS;
-	int wstatus = 0; /* pid wait status */
-	int exit_status = -1;
+	if (has_key && silk_cache_fetch(key, action->output))
+	{
+		return 0;
+	}
 
-	ssize_t bytes_read = 0;   /* Byte read count when we retrieve the output of the child process. */
-	char buffer[256] = { 0 }; /* Buffer to get the output of the child process. */
-	int stdout_pfd[2] = { 0 };     /* Pipe file descriptor for stdout. */
-	int stderr_pfd[2] = { 0 };     /* Pipe file descriptor for stderr. */
+	exit_code = silk_gcc_compile(action);
+
+	if (has_key && exit_code == 0)
+	{
+		silk_cache_store(key, action->output);
+	}
 
-	silk_darrT_init(&args);
+	return exit_code;
+}
 
-	silk_log_debug("Running process '%s'", handle->cmd);
-	if (handle->starting_directory && handle->starting_directory[0])
+/* Write the generated unity file number 'index' and add it to the sources.
+   In a dry run the file is not written, it's added to 'changed' if it would be. */
+SILK_INTERNAL silk_bool
+silk_gcc_write_unity_file(const char* output_dir, silk_size index, const char* ext, silk_dstr* content, silk_dstr* buffer, silk_dstr* sources, silk_dstr* changed)
+{
+	silk_size tmp_index = silk_tmp_save();
+	const char* path = silk_tmp_sprintf("%sunity/unity_%d%s", output_dir, (int)index, ext);
+	silk_bool result = silk_true;
+
+	if (silk_dry_run_enabled)
+	{
+		if (!silk_read_file(path, buffer) || buffer->size != content->size || memcmp(buffer->data, content->data, content->size) != 0)
+		{
+			silk_dstr_push_str(changed, path);
+		}
+	}
+	else
 	{
-		silk_log_debug("Subprocess started in directory '%s'", handle->starting_directory);
+		silk_create_directories(path, strlen(path));
+
+		/* Unchanged unity files are not rewritten so they are not compiled again. */
+		result = silk_write_file_if_changed(path, content->data, content->size, buffer);
 	}
+	silk_dstr_push_str(sources, path);
 
-	/* Ensure that everything is written into the outputs before creating a new process that will also write in those outputs */
-	fflush(stdout);
-	fflush(stderr);
+	silk_tmp_restore(tmp_index);
+	return result;
+}
 
-	/* Split args from the command line and add it to the array. */
-	while ((cmd_cursor = silk_get_next_arg(cmd_cursor, &arg)) != NULL)
-	{
-		silk_darrT_push_back(&args, silk_tmp_strv_to_str(arg));
-	}
+/* Remove the unity files numbered 'count' and above, and what was built from them, left by a build with more unity files. */
+SILK_INTERNAL void
+silk_gcc_remove_stale_unity_files(const char* output_dir, silk_size count)
+{
+	const char* directory = silk_tmp_sprintf("%sunity/", output_dir);
+	DIR* dir = opendir(directory);
+	struct dirent* entry = NULL;
+	char* end = NULL;
+	long index = 0;
+	silk_size tmp_index = 0;
 
-	/* Last value of the args should be a null value, only append if necessary */
-	if (args.darr.size > 0)
+	if (!dir)
 	{
-		silk_darrT_push_back(&args, NULL);
+		return;
 	}
 
-	if (handle->stdout_to_string)
+	while ((entry = readdir(dir)) != NULL)
 	{
-		if (pipe(stdout_pfd) == -1)
+		if (strncmp(entry->d_name, "unity_", 6) != 0)
 		{
-			silk_log_error("Pipe creation failed for stdout_pfd.");
-			silk_set_and_goto(exit_status, -1, cleanup);
+			continue;
 		}
-	}
-	if (handle->stderr_to_string)
-	{
-		if (pipe(stderr_pfd) == -1)
+
+		index = strtol(entry->d_name + 6, &end, 10);
+		if (end != entry->d_name + 6 && *end == '.' && index >= 0 && (silk_size)index >= count)
 		{
-			silk_log_error("Pipe creation failed for stderr_pfd.");
-			silk_set_and_goto(exit_status, -1, cleanup);
+			tmp_index = silk_tmp_save();
+			remove(silk_tmp_sprintf("%s%s", directory, entry->d_name));
+			silk_tmp_restore(tmp_index);
 		}
 	}
+	closedir(dir);
+}
+
+/* Absolute path of the files to compile, written in 'sources' as null-terminated strings one after the other.
+   With silk_UNITY_BUILD the files are gathered in generated unity files including several of them,
+   headers shared by these files are parsed once. Excluded files and files of another language than the
+   ones before them in silk_FILES are compiled on their own.
+   In a dry run, the unity files which would be written are listed in 'changed' instead.
+   Returns the number of files to compile, SILK_NPOS if a unity file could not be written. */
+SILK_INTERNAL silk_size
+silk_gcc_compile_units(silk_project_t* project, const char* output_dir, silk_dstr* sources, silk_dstr* changed)
+{
+	silk_dstr excluded; /* Absolute path of the excluded files, null-terminated strings one after the other. */
+	silk_dstr unity;    /* Content of the unity file being filled. */
+	silk_dstr unity_ext;
+	silk_dstr buffer;
+	silk_strv batch_size_value;
+	silk_strv ext;
+	silk_kv_range range;
+	silk_kv current;
+	const char* source = NULL;
+	const char* cursor = NULL;
+	silk_size batch_size = 0;
+	silk_size batched = 0; /* Number of files in the unity file being filled */
+	silk_size unity_count = 0;
+	silk_size count = 0;
+	silk_size ext_pos = 0;
+	silk_size tmp_index = 0;
+	silk_bool is_excluded = silk_false;
 
-	pid = silk_fork_process((char**)args.darr.data, handle, stdout_pfd, stderr_pfd);
+	silk_dstr_init(&excluded);
+	silk_dstr_init(&unity);
+	silk_dstr_init(&unity_ext);
+	silk_dstr_init(&buffer);
 
-	if (pid == SILK_INVALID_PROCESS)
+	if (try_get_property_strv(project, silk_UNITY_BUILD, &batch_size_value) && atoi(batch_size_value.data) > 1)
 	{
-		silk_set_and_goto(exit_status, -1, cleanup);
+		batch_size = (silk_size)atoi(batch_size_value.data);
 	}
 
-	/* wait for process to be done */
-	for (;;) {
-		if (waitpid(pid, &wstatus, 0) < 0) {
-			silk_log_error("Could not wait on command (pid %d): '%s'", pid, strerror(errno));
-			silk_set_and_goto(exit_status, -1, cleanup);
-		}
-
-		if (WIFEXITED(wstatus)) {
-			exit_status = WEXITSTATUS(wstatus);
-			if (exit_status != 0) {
-				silk_log_error("Command exited with exit code '%d'", exit_status);
-				silk_set_and_goto(exit_status, -1, cleanup);
-			}
-
-			break; /* Get out of the loop since the process exited. */
-		}
-
-		if (WIFSIGNALED(wstatus)) {
-			silk_log_error("Command process was terminated by '%s'", strsignal(WTERMSIG(wstatus)));
-			silk_set_and_goto(exit_status, -1, cleanup);
-		}
+	range = silk_mmap_get_range_str(&project->mmap, silk_UNITY_EXCLUDE);
+	while (silk_mmap_range_get_next(&range, &current))
+	{
+		tmp_index = silk_tmp_save();
+		silk_dstr_push_str(&excluded, silk_path_get_absolute_file(current.u.strv.data));
+		silk_tmp_restore(tmp_index);
 	}
 
-	if (handle->stdout_to_string)
+	range = silk_mmap_get_range_str(&project->mmap, silk_FILES);
+	while (silk_mmap_range_get_next(&range, &current))
 	{
-		/* Close the write pipe since the child program has been exited. */
-		close(stdout_pfd[1]);
+		/* Absolute file is created using the tmp buffer allocator but we don't need it once it's inserted into the dynamic string */
+		tmp_index = silk_tmp_save();
+		source = silk_path_get_absolute_file(current.u.strv.data);
 
-		/* Read output of the child process from the read file description of the pipe. */
-		while ((bytes_read = read(stdout_pfd[0], buffer, sizeof(buffer))) > 0)
+		is_excluded = silk_false;
+		for (cursor = excluded.data; !is_excluded && cursor < excluded.data + excluded.size; cursor += strlen(cursor) + 1)
 		{
-			silk_dstr_append_f(&handle->stdout_string, "%.*s", (int)bytes_read, buffer);
+			is_excluded = strcmp(cursor, source) == 0;
 		}
-		/* Close the read pipe since we read all the information from it. */
-		close(stdout_pfd[0]);
-	}
 
-	if (handle->stderr_to_string)
-	{
-		/* Close the write pipe since the child program has been exited. */
-		close(stderr_pfd[1]);
+		if (batch_size == 0 || is_excluded)
+		{
+			silk_dstr_push_str(sources, source);
+			count += 1;
+			silk_tmp_restore(tmp_index);
+			continue;
+		}
 
-		if (handle->stderr_to_string)
+		ext = silk_strv_make_str(source);
+		ext_pos = silk_rfind(ext, '.');
+		ext = ext_pos != SILK_NPOS ? silk_strv_make(ext.data + ext_pos, ext.size - ext_pos) : silk_strv_make_str(".c");
+
+		/* A C file is not compiled with C++ files */
+		if (batched > 0 && !silk_strv_equals(ext, unity_ext.data, unity_ext.size))
 		{
-			/* Read output of the child process from the read file description of the pipe. */
-			while ((bytes_read = read(stderr_pfd[0], buffer, sizeof(buffer))) > 0)
+			if (!silk_gcc_write_unity_file(output_dir, unity_count, unity_ext.data, &unity, &buffer, sources, changed))
 			{
-				silk_dstr_append_f(&handle->stderr_string, "%.*s", (int)bytes_read, buffer);
+				silk_tmp_restore(tmp_index);
+				silk_set_and_goto(count, SILK_NPOS, exit);
 			}
-			/* Close the read pipe since we read all the information from it. */
-			close(stderr_pfd[0]);
+			unity_count += 1;
+			count += 1;
+			batched = 0;
 		}
-	}
-
-cleanup:
-	silk_darrT_destroy(&args);
-	handle->exit_code = exit_status;
-	return handle;
-}
-
-#endif
-
-#ifdef _WIN32
 
-/* ================================================================ */
-/* toolchain MSVC */
-/* ================================================================ */
+		if (batched == 0)
+		{
+			silk_dstr_assign_str(&unity, "/* Generated by silk, do not edit. */\n");
+			silk_dstr_assign_f(&unity_ext, "%.*s", (int)ext.size, ext.data);
+		}
 
-/* #msvc #toolchain */
+		silk_dstr_append_f(&unity, "#include \"%s\"\n", source);
+		batched += 1;
 
-SILK_API const char*
-silk_toolchain_msvc_bake(silk_toolchain* tc, const char* project_name)
-{
-	silk_dstr str; /* cl.exe command */
-	/* @FIXME use an array of string instead to make it straigthforward to follow */
-	silk_dstr str_obj; /* to keep track of the .obj generated and copy them.*/
-	const char* output_dir;       /* Output directory. Contains the directory path of the binary being created. */
-	
-	silk_kv_range range = { 0 };
-	silk_kv_range lflag_range = { 0 };
-	silk_kv current = { 0 };       /* Temporary kv to store results. */
-	silk_kv current_lflag = { 0 }; /* Temporary kv to linker flags. */
-	silk_strv basename = { 0 };
-	const char* artefact = NULL; /* Resulting artefact path */
-	const char* ext = "";        /* Resulting artefact extension */
-	const char* _ = "  ";        /* Space to separate command arguments. */
-	const char* tmp = "";
-	
-	silk_strv linked_project_name = { 0 };
-	silk_project_t* linked_project = NULL;
-	const char* linked_output_dir; /* to keep track of the .obj generated */
-	const char* path_prefix = NULL;
-	silk_project_t* project = NULL;
-	silk_size tmp_index;
-	project = silk_find_project_by_name_str(project_name);
+		if (batched == batch_size)
+		{
+			if (!silk_gcc_write_unity_file(output_dir, unity_count, unity_ext.data, &unity, &buffer, sources, changed))
+			{
+				silk_tmp_restore(tmp_index);
+				silk_set_and_goto(count, SILK_NPOS, exit);
+			}
+			unity_count += 1;
+			count += 1;
+			batched = 0;
+		}
 
-	if (!project)
-	{
-		return NULL;
+		silk_tmp_restore(tmp_index);
 	}
-	
-	silk_dstr_init(&str);
-	silk_dstr_init(&str_obj);
-
-	/* Get and format output directory */
-	output_dir = silk_get_output_directory(project, tc);
-
-	/* Create output directory if it does not exist yet. */
-	silk_create_directories(output_dir, strlen(output_dir));
-
-	/* Use /utf-8 by default since it's retrocompatible with utf-8 */
-	/* Use /nologo to avoid undesirable messages in the command line. */
-	silk_dstr_append_str(&str, "cl.exe /utf-8 /nologo ");
-
-	/* Handle binary type */
-
-	silk_bool is_exe = silk_property_equals(project, silk_BINARY_TYPE, silk_EXE);
-	silk_bool is_shared_library = silk_property_equals(project, silk_BINARY_TYPE, silk_SHARED_LIBRARY);
-	silk_bool is_static_library = silk_property_equals(project, silk_BINARY_TYPE, silk_STATIC_LIBRARY);
 
-	if (!is_exe && !is_shared_library && !is_static_library)
+	if (batched > 0)
 	{
-		silk_log_error("Unknown binary type");
-		silk_set_and_goto(artefact, NULL, exit);
+		if (!silk_gcc_write_unity_file(output_dir, unity_count, unity_ext.data, &unity, &buffer, sources, changed))
+		{
+			silk_set_and_goto(count, SILK_NPOS, exit);
+		}
+		unity_count += 1;
+		count += 1;
 	}
 
-	if (is_static_library) {
-		silk_dstr_append_str(&str, "/c ");
-	}
-	else if (is_shared_library) {
-		silk_dstr_append_str(&str, "/LD ");
+	if (!silk_dry_run_enabled)
+	{
+		tmp_index = silk_tmp_save();
+		silk_gcc_remove_stale_unity_files(output_dir, unity_count);
+		silk_tmp_restore(tmp_index);
 	}
 
-	/* Add output directory to cl.exe command */
-	/* /Fo"output/directory/" */
-	silk_dstr_append_f(&str, "/Fo\"%s\" ", output_dir);
+exit:
+	silk_dstr_destroy(&excluded);
+	silk_dstr_destroy(&unity);
+	silk_dstr_destroy(&unity_ext);
+	silk_dstr_destroy(&buffer);
+	return count;
+}
 
-	ext = is_exe ? ".exe" : ext;
-	ext = is_static_library ? ".lib" : ext;
-	ext = is_shared_library ? ".dll" : ext;
+/* Modification time newer than any file, the objects compared to it are stale. */
+#define SILK_GCC_MTIME_FORCE_STALE 1e300
 
-	artefact = silk_tmp_sprintf("%s%s%s", output_dir, project_name, ext);
+/* Position of the directory in silk_pch_claimed, SILK_NPOS if it's not there. Must be called with silk_shared_mutex locked. */
+SILK_INTERNAL silk_size
+silk_gcc_pch_find_claim(const char* directory)
+{
+	const char* cursor = NULL;
 
-	/* Define binary output for executable and shared library. Static library is set with the link.exe command*/
-	if (is_exe || is_shared_library)
+	for (cursor = silk_pch_claimed.data; cursor < silk_pch_claimed.data + silk_pch_claimed.size; cursor += strlen(cursor) + 1)
 	{
-		/* /Fe"output/directory/bin.ext" */
-		silk_dstr_append_f(&str, "/Fe\"%s\" ", artefact);
+		if (strcmp(cursor, directory) == 0)
+		{
+			return (silk_size)(cursor - silk_pch_claimed.data);
+		}
 	}
+	return SILK_NPOS;
+}
 
-	/* Append compiler flags */
+/* Wait until no other project checks or builds the precompiled header of 'directory', then claim it.
+   The lock is not held while the header is precompiled, other precompiled headers and the linker checks don't wait for it. */
+SILK_INTERNAL void
+silk_gcc_pch_claim(const char* directory)
+{
+	silk_mutex_lock(&silk_shared_mutex);
+	while (silk_gcc_pch_find_claim(directory) != SILK_NPOS)
 	{
-		range = silk_mmap_get_range_str(&project->mmap, silk_CXFLAGS);
-		while (silk_mmap_range_get_next(&range, &current))
-		{
-			silk_dstr_append_f(&str,"%s ", current.u.strv.data);
-		}
+		silk_cond_wait(&silk_pch_cond, &silk_shared_mutex);
 	}
+	silk_dstr_push_str(&silk_pch_claimed, directory);
+	silk_mutex_unlock(&silk_shared_mutex);
+}
 
-	/* Append include directories */
+SILK_INTERNAL void
+silk_gcc_pch_release(const char* directory)
+{
+	silk_size position = 0;
+	silk_size size = strlen(directory) + 1;
+
+	silk_mutex_lock(&silk_shared_mutex);
+	position = silk_gcc_pch_find_claim(directory);
+	SILK_ASSERT(position != SILK_NPOS);
+	memmove(silk_pch_claimed.data + position, silk_pch_claimed.data + position + size, silk_pch_claimed.size - position - size);
+	silk_pch_claimed.size -= size;
+	silk_pch_claimed.data[silk_pch_claimed.size] = '\0';
+	silk_cond_broadcast(&silk_pch_cond);
+	silk_mutex_unlock(&silk_shared_mutex);
+}
+
+/* Precompile the header for each language of the sources, C and C++ headers are stored in the same ".gch" directory.
+   The precompiled header depends on the flags, it's shared by all the projects compiled with the same flags.
+   Dependency files of the objects don't list the headers found in a precompiled header so 'newest_mtime' receives
+   the modification time of the most recent precompiled header and 'digest' the digest of the headers it contains.
+   With a 'plan' the header is not precompiled, the precompilation is added to the plan.
+   Returns the flags making the compile commands include it, NULL if it could not be precompiled. */
+SILK_INTERNAL const char*
+silk_gcc_precompile_header(const silk_toolchain* tc, silk_file_cache* files, const char* header, const char* cflags, const char* sources, silk_size source_count,
+	silk_dstr* content, silk_dstr* deps, double* newest_mtime, silk_digest* digest, silk_plan* plan)
+{
+	const char* languages[2] = { NULL, NULL };
+	const char* source = NULL;
+	const char* directory = NULL;
+	const char* wrapper = NULL; /* Header including the precompiled header, gcc looks for the ".gch" next to it. */
+	const char* gch = NULL;
+	const char* depfile = NULL;
+	const char* reason = NULL;
+	const char* result = NULL;
+	double gch_mtime = 0;
+	silk_strv ext;
+	silk_strv list; /* Headers of the precompiled header */
+	silk_size i = 0;
+	int exit_code = 0;
+	silk_digest language_digests[2];
+	char hex[SILK_DIGEST_HEX_SIZE + 1];
+
+	memset(language_digests, 0, sizeof(language_digests));
+
+	for (source = sources; source_count > 0; source_count--, source += strlen(source) + 1)
 	{
-		range = silk_mmap_get_range_str(&project->mmap, silk_INCLUDE_DIRECTORIES);
-		while (silk_mmap_range_get_next(&range, &current))
+		ext = silk_strv_make_str(source);
+		if (silk_strv_ends_with(ext, silk_strv_make_str(".c")))
 		{
-			/* Absolute file is created using the tmp buffer allocator but we don't need it once it's inserted into the dynamic string */
-			tmp_index = silk_tmp_save();
-			silk_dstr_append_f(&str, "/I\"%s\" ", silk_path_get_absolute_dir(current.u.strv.data));
-			silk_tmp_restore(tmp_index);
+			languages[0] = "c";
 		}
-	}
-	
-	/* Append preprocessor definition */
-	{
-		range = silk_mmap_get_range_str(&project->mmap, silk_DEFINES);
-		while (silk_mmap_range_get_next(&range, &current))
+		else if (silk_strv_ends_with(ext, silk_strv_make_str(".cpp"))
+			|| silk_strv_ends_with(ext, silk_strv_make_str(".cc"))
+			|| silk_strv_ends_with(ext, silk_strv_make_str(".cxx")))
 		{
-			silk_dstr_append_f(&str, "/D\"%s\" ", current.u.strv.data);
+			languages[1] = "c++";
 		}
 	}
 
-	/* Append files and .obj */
-	{
-		range = silk_mmap_get_range_str(&project->mmap, silk_FILES);
-		while (silk_mmap_range_get_next(&range, &current))
-		{
-			/* Absolute file is created using the tmp buffer allocator but we don't need it once it's inserted into the dynamic string */
-			tmp_index = silk_tmp_save();
-
-			silk_dstr_append_f(&str, "\"%s\" ", silk_path_get_absolute_file(current.u.strv.data));
+	/* Example: .build/gcc/pch/<digest of the flags and header>/pch.h */
+	silk_dstr_assign_str(content, cflags);
+	silk_dstr_append_from(content, content->size, header, strlen(header) + 1);
+	silk_digest_to_hex(silk_digest_make(content->data, content->size, 0), hex);
 
-			silk_tmp_restore(tmp_index);
+	directory = silk_path_get_absolute_dir(silk_path_combine(silk_path_combine(tc->default_directory_base, "pch"), hex));
+	wrapper = silk_tmp_sprintf("%spch.h", directory);
+	silk_dstr_assign_f(content, "#include \"%s\"\n", header);
 
-			basename = silk_path_basename(current.u.strv);
+	silk_gcc_pch_claim(directory);
 
-			silk_dstr_append_f(&str_obj, "\"%.*s.obj\" ", basename.size, basename.data);
+	/* In a dry run, a missing wrapper means the header has never been precompiled with these flags */
+	if (!plan)
+	{
+		silk_create_directories(directory, strlen(directory));
+		if (!silk_write_file_if_changed(wrapper, content->data, content->size, deps))
+		{
+			silk_set_and_goto(result, NULL, exit);
 		}
 	}
 
-	/* Append libraries */
+	for (i = 0; i < 2; ++i)
 	{
-		range = silk_mmap_get_range_str(&project->mmap, silk_LIBRARIES);
-		while (silk_mmap_range_get_next(&range, &current))
+		if (!languages[i])
 		{
-			silk_dstr_append_f(&str, "\"%s.lib\" ", current.u.strv.data);
+			continue;
 		}
-	}
 
-	/* For each linked project we add the link information to the cl.exe command */
-	range = silk_mmap_get_range_str(&project->mmap, silk_LINK_PROJECTS);
-	if (range.count > 0)
-	{
-		silk_dstr_append_str(&str, "/link ");
-		/* Add linker flags */
+		gch = silk_tmp_sprintf("%spch.h.gch/%s.gch", directory, languages[i]);
+		depfile = silk_tmp_sprintf("%spch.h.gch/%s.d", directory, languages[i]);
+
+		reason = silk_gcc_object_stale_reason(files, NULL, directory, wrapper, gch, "precompiled header", depfile, content, deps, &gch_mtime);
+		if (reason && plan)
 		{
-			lflag_range = silk_mmap_get_range_str(&project->mmap, silk_LFLAGS);
-			while (silk_mmap_range_get_next(&lflag_range, &current_lflag))
-			{
-				silk_dstr_append_strv(&str, current_lflag.u.strv);
-				silk_dstr_append_str(&str, _);
-			}
+			/* Precompiled now, all the objects are compiled again. Headers are not known yet, the digest is left empty. */
+			silk_plan_add(plan, "precompile", silk_tmp_sprintf("%s (%s)", header, languages[i]), reason, -1);
+			*newest_mtime = SILK_GCC_MTIME_FORCE_STALE;
+			continue;
 		}
 
-		/* iterate all the linked projects */
-		while (silk_mmap_range_get_next(&range, &current))
+		if (reason)
 		{
-			linked_project_name = current.u.strv;
+			silk_log_debug("Precompiling '%s' for %s: %s.", header, languages[i], reason);
+			silk_create_directories(gch, strlen(gch));
 
-			linked_project = silk_find_project_by_name(linked_project_name);
-			if (!project)
+			/* Example: cc <flags> <includes> -x c-header -MMD -MF "pch.h.gch/c.d" -c "pch.h" -o "pch.h.gch/c.gch" */
+			silk_job_acquire();
+			exit_code = silk_gcc_process(
+				silk_tmp_sprintf("cc %s-x %s-header -MMD -MF \"%s\" -c \"%s\" -o \"%s\"", cflags, languages[i], depfile, wrapper, gch),
+				directory, silk_tmp_sprintf("%s.rsp", gch));
+			silk_job_release();
+
+			if (exit_code != 0 || !silk_file_mtime(gch, &gch_mtime))
 			{
-				silk_set_and_goto(artefact, NULL, exit);
+				silk_set_and_goto(result, NULL, exit);
 			}
+		}
 
-			linked_output_dir = silk_get_output_directory(linked_project, tc);
+		*newest_mtime = gch_mtime > *newest_mtime ? gch_mtime : *newest_mtime;
 
-			/* is shared or static library */
-			if (silk_property_equals(linked_project, silk_BINARY_TYPE, silk_SHARED_LIBRARY)
-				|| silk_property_equals(linked_project, silk_BINARY_TYPE, silk_STATIC_LIBRARY))
-			{
-				/* /LIBPATH:"output/dir/" "mlib.lib" */
-				silk_dstr_append_f(&str, "/LIBPATH:\"%s\" \"%.*s.lib\" ", linked_output_dir, linked_project_name.size, linked_project_name.data);
-			}
+		if (!silk_gcc_object_deps(NULL, directory, gch, depfile, content, deps, &list)
+			|| !silk_gcc_object_digest(files, "", list, content, &language_digests[i]))
+		{
+			silk_set_and_goto(result, NULL, exit);
+		}
+	}
 
-			/* is shared library */
-			if (silk_property_equals(linked_project, silk_BINARY_TYPE, silk_SHARED_LIBRARY))
-			{
-				path_prefix = silk_tmp_sprintf("%s%.*s", linked_output_dir, linked_project_name.size, linked_project_name.data);
-				/* .dll */
-				tmp = silk_tmp_sprintf("%s.dll", path_prefix);
-				if (!silk_copy_file_to_dir(tmp, output_dir))
-				{
-					silk_set_and_goto(artefact, NULL, exit);
-				}
+	*digest = silk_digest_make((const char*)language_digests, sizeof(language_digests), 0);
 
-				/* .exp */
-				tmp = silk_tmp_sprintf("%s.exp", path_prefix);
-				if (!silk_copy_file_to_dir(tmp, output_dir))
-				{
-					silk_log_warning("Missing .exp. Shared libraries usually need to have some symbol exported with '__declspec(dllexport)'");
-					silk_set_and_goto(artefact, NULL, exit);
-				}
+	/* -Winvalid-pch tells when the header is parsed again because the precompiled one can't be used */
+	result = silk_tmp_sprintf("-include \"%s\" -Winvalid-pch ", wrapper);
+
+exit:
+	silk_gcc_pch_release(directory);
+	return result;
+}
+
+/* Linkers tried in this order with silk_AUTO, and the option making them use several threads. */
+static const char* silk_gcc_known_linkers[3] = { "mold", "lld", "gold" };
+static const char* silk_gcc_known_linker_threads[3] = { "-Wl,--thread-count=%d ", "-Wl,--threads=%d ", "-Wl,--threads -Wl,--thread-count=%d " };
+static int silk_gcc_known_linker_status[3] = { 0, 0, 0 }; /* 0 when not checked yet, 1 if installed, -1 otherwise. */
+
+/* Returns true if the compiler finds the linker given to -fuse-ld. Known linkers are only checked once. */
+SILK_INTERNAL silk_bool
+silk_gcc_linker_is_available(const char* linker, silk_size known)
+{
+	silk_process_handle* handle = NULL;
+	int status = 0;
+
+	silk_mutex_lock(&silk_shared_mutex);
+	status = known != SILK_NPOS ? silk_gcc_known_linker_status[known] : 0;
+	if (status == 0)
+	{
+		/* The linker only prints its version when the compiler finds it. */
+		handle = silk_create_process_handle(silk_tmp_sprintf("cc -fuse-ld=%s -Wl,--version", linker), NULL);
+		handle->stdout_to_string = silk_true;
+		handle->stderr_to_string = silk_true;
+		handle->quiet = silk_true;
+		status = silk_process_end(silk_process_core(handle)) == 0 ? 1 : -1;
+		if (known != SILK_NPOS)
+		{
+			silk_gcc_known_linker_status[known] = status;
+		}
+	}
+	silk_mutex_unlock(&silk_shared_mutex);
 
-				/* .lib */
-				tmp = silk_tmp_sprintf("%s.lib", path_prefix);
-				if (!silk_copy_file_to_dir(tmp, output_dir))
-				{
-					silk_log_warning("Missing .lib file. Shared libraries must create a .lib file for other program to be linked with at compile time.");
-					silk_set_and_goto(artefact, NULL, exit);
-				}
+	return status == 1;
+}
 
-				/* Copy .pdb if there is any. */
-				tmp = silk_tmp_sprintf("%s.pdb", path_prefix);
-				silk_try_copy_file_to_dir(tmp, output_dir);
-			}
+/* Flags selecting the linker of silk_LINKER, empty to keep the default linker.
+   The flags making the linker use several threads are written in 'threads', they don't change the result of the link. */
+SILK_INTERNAL const char*
+silk_gcc_linker_flags(const char* linker, const char** threads)
+{
+	silk_bool is_auto = strcmp(linker, silk_AUTO) == 0;
+	silk_size known = SILK_NPOS;
+	silk_size i = 0;
+
+	*threads = "";
+
+	for (i = 0; i < 3; ++i)
+	{
+		if (is_auto ? silk_gcc_linker_is_available(silk_gcc_known_linkers[i], i) : strcmp(linker, silk_gcc_known_linkers[i]) == 0)
+		{
+			known = i;
+			break;
 		}
 	}
 
-	/* execute cl.exe */
-	if (silk_process_in_directory(str.data, output_dir) != 0)
+	if (is_auto && known == SILK_NPOS)
 	{
-		silk_set_and_goto(artefact, NULL, exit);
+		return "";
 	}
-	
-	if (is_static_library)
+
+	if (!is_auto && !silk_gcc_linker_is_available(linker, known))
 	{
-		/* lib.exe /NOLOGO /OUT:"output/dir/my_lib.lib" /LIBPATH:"output/dir/" a.obj b.obj c.obj ... */
-		tmp = silk_tmp_sprintf("lib.exe /NOLOGO /OUT:\"%s\"  /LIBPATH:\"%s\" %s ", artefact, output_dir, str_obj.data);
-		if (silk_process_in_directory(tmp, output_dir) != 0)
-		{
-			silk_log_error("Could not execute command to build static library\n");
-			silk_set_and_goto(artefact, NULL, exit);
-		}
+		silk_log_warning("Linker '%s' is not installed, using the default linker.", linker);
+		return "";
 	}
 
-exit:
-	silk_dstr_destroy(&str);
-	silk_dstr_destroy(&str_obj);
+	if (known == SILK_NPOS)
+	{
+		return silk_tmp_sprintf("-fuse-ld=%s ", linker);
+	}
 
-	return artefact;
+	/* Example: -fuse-ld=mold -Wl,--thread-count=8 */
+	*threads = silk_tmp_sprintf(silk_gcc_known_linker_threads[known], (int)silk_get_job_count());
+	return silk_tmp_sprintf("-fuse-ld=%s ", silk_gcc_known_linkers[known]);
 }
 
-SILK_API silk_toolchain
-silk_toolchain_msvc(void)
+SILK_INTERNAL int
+silk_strv_sort_compare(const void* left, const void* right)
 {
-	silk_toolchain tc;
-	tc.bake = silk_toolchain_msvc_bake;
-	tc.name = "msvc";
-	tc.default_directory_base = ".build/msvc";
-	return tc;
+	return silk_strv_compare_strv(*(const silk_strv*)left, *(const silk_strv*)right);
 }
 
-#else
+/* Returns true if two objects of the list have the same file name, an archive can't tell which one to replace.
+   'objects' is a list of double quoted paths: "a/x.o" "b/y.o" */
+SILK_INTERNAL silk_bool
+silk_gcc_objects_share_a_name(const char* objects)
+{
+	silk_darrT(silk_strv) names;
+	silk_strv path;
+	const char* begin = objects;
+	const char* end = NULL;
+	silk_size separator = 0;
+	silk_size i = 0;
+	silk_bool result = silk_false;
 
-/* ================================================================ */
-/* toolchain GCC */
-/* ================================================================ */
+	silk_darrT_init(&names);
 
-/* #gcc #toolchain */
+	while ((begin = strchr(begin, '"')) != NULL && (end = strchr(begin + 1, '"')) != NULL)
+	{
+		path = silk_strv_make(begin + 1, end - begin - 1);
+		separator = silk_rfind2(path, '/', '\\');
+		if (separator != SILK_NPOS)
+		{
+			path = silk_strv_make(path.data + separator + 1, path.size - separator - 1);
+		}
+		silk_darrT_push_back(&names, path);
+		begin = end + 1;
+	}
 
+	qsort(names.darr.data, silk_darrT_size(&names), sizeof(silk_strv), silk_strv_sort_compare);
+
+	for (i = 1; !result && i < silk_darrT_size(&names); ++i)
+	{
+		result = silk_strv_equals_strv(silk_darrT_at(&names, i - 1), silk_darrT_at(&names, i));
+	}
+
+	silk_darrT_destroy(&names);
+	return result;
+}
+
+/* The artefact needs to be created if it does not exist or if one of its inputs is newer. */
 SILK_INTERNAL silk_bool
-silk_strv_ends_with(silk_strv sv, silk_strv rhs)
+silk_gcc_artefact_is_up_to_date(const char* artefact, double newest_input_mtime)
 {
-	silk_strv sub = { 0 };
-	if (sv.size < rhs.size)
+	double artefact_mtime = 0;
+	return silk_file_mtime(artefact, &artefact_mtime) && artefact_mtime >= newest_input_mtime;
+}
+
+/* Add the entries of the project to the compilation database.
+   Files of a unity build get their own entry, as if they were compiled alone, so the tools see each of them. */
+SILK_INTERNAL void
+silk_gcc_write_compile_commands(silk_project_t* project, const char* output_dir, const char* cflags)
+{
+	silk_dstr entries;
+	silk_kv_range range;
+	silk_kv current;
+	silk_strv arg;
+	const char* source = NULL;
+	const char* object = NULL;
+	const char* cursor = NULL;
+	silk_size tmp_index = 0;
+	silk_bool first = silk_true;
+
+	silk_dstr_init(&entries);
+
+	range = silk_mmap_get_range_str(&project->mmap, silk_FILES);
+	while (silk_mmap_range_get_next(&range, &current))
 	{
-		return silk_false;
+		tmp_index = silk_tmp_save();
+		source = silk_path_get_absolute_file(current.u.strv.data);
+		object = silk_gcc_object_path(output_dir, source);
+
+		silk_dstr_append_str(&entries, entries.size > 0 ? ",\n{\"directory\":" : "{\"directory\":");
+		silk_dstr_append_json_string(&entries, output_dir);
+
+		/* The arguments are split here so the tools don't have to deal with the quotes */
+		silk_dstr_append_str(&entries, ",\"arguments\":[");
+		cursor = silk_tmp_sprintf("cc %s-c \"%s\" -o \"%s\"", cflags, source, object);
+		first = silk_true;
+		while ((cursor = silk_get_next_arg(cursor, &arg)) != NULL)
+		{
+			silk_dstr_append_str(&entries, first ? "" : ",");
+			silk_dstr_append_json_string(&entries, silk_tmp_sprintf("%.*s", (int)arg.size, arg.data));
+			first = silk_false;
+		}
+
+		silk_dstr_append_str(&entries, "],\"file\":");
+		silk_dstr_append_json_string(&entries, source);
+		silk_dstr_append_str(&entries, ",\"output\":");
+		silk_dstr_append_json_string(&entries, object);
+		silk_dstr_append_str(&entries, "}");
+
+		silk_tmp_restore(tmp_index);
 	}
 
-	sub = silk_strv_make(sv.data + (sv.size - rhs.size), rhs.size);
-	return silk_strv_equals_strv(sub, rhs);
+	silk_compile_commands_add(silk_tmp_sprintf("%s" SILK_COMPILE_COMMANDS_FRAGMENT, output_dir, project->name.data), entries.data ? entries.data : "", entries.size);
+
+	silk_dstr_destroy(&entries);
 }
 
 SILK_API const char*
 silk_toolchain_gcc_bake(silk_toolchain* tc, const char* project_name)
 {
-	silk_dstr str;
+	silk_dstr cflags;  /* Flags given to every compile command. */
+	silk_dstr str;     /* Link or archive command. */
 	silk_dstr str_obj; /* to keep track of the .o generated */
+	silk_dstr changed_obj; /* Objects newer than the static library */
+	silk_dstr members;     /* Objects of the static library */
+	silk_strv recorded_members; /* Objects of the static library the last time it was archived */
+	silk_bool thin = silk_false;
+	silk_bool same_members = silk_false; /* The static library contains the same objects as the last time */
+	double artefact_mtime = 0;
+	silk_dstr strings; /* Storage of the compile commands, null-terminated strings one after the other. */
+	silk_dstr sources; /* Files to compile, null-terminated strings one after the other. */
+	silk_dstr changed_units; /* Unity files a dry run would write, they are compiled in the plan. */
+	const char* cursor = NULL;
+	silk_strv precompiled_header;
+	silk_strv linker;
+	const char* linker_threads = "";   /* Not part of the fingerprint of the link command */
+	double pch_mtime = 0;              /* Objects older than the precompiled header are compiled again. */
+	silk_digest pch_digest;
+	char pch_key[SILK_DIGEST_HEX_SIZE + 1] = { 0 }; /* Digest of the precompiled header, empty if there is none. */
+	silk_size source_count = 0;
+	silk_darrT(silk_size) cmd_offsets;   /* Offset of each compile command, source and object in 'strings'. */
+	silk_darrT(silk_action) actions;     /* One compile action per file. */
+	silk_action action = { 0 };
+	silk_gcc_compile_flags compile_flags;
 	const char* output_dir;        /* Output directory. Contains the directory path of the binary being created. */
-	silk_darrT(const char*) objects; /* Contains the path of all .o objects */
+	const char* source = NULL;
+	const char* reason = NULL;         /* Why an object needs to be compiled. */
+	silk_file_cache files;             /* Headers are usually included by many files, they are only checked once. */
+	silk_bool content_hash = silk_false; /* silk_CONTENT_HASH rebuild mode */
+	silk_bool compiled = silk_false;     /* All the compilations succeeded */
+	silk_dstr depfile_content;
+	silk_dstr depfile_deps;
+	silk_db db;                        /* What the previous builds recorded: durations, fingerprints, dependencies, etc. */
+	silk_plan plan;                    /* Commands a dry run would run */
+	silk_bool has_history = silk_false;  /* Some of the compilations ran before, their expected durations mean something */
+	double expected_duration = 0;
+	silk_bool linked_rebuilt = silk_false; /* A linked library is rebuilt by the dry run */
+	double start_time = 0;
+	double object_mtime = 0;
+	double newest_input_mtime = 0;     /* Most recent modification of an input of the link or archive command. */
+	int exit_code = 0;
 
 	silk_bool is_exe = silk_false;
 	silk_bool is_static_library = silk_false;
@@ -2858,13 +8313,11 @@ silk_toolchain_gcc_bake(silk_toolchain* tc, const char* project_name)
 	silk_kv_range lflag_range = { 0 };
 	silk_kv current_lflag = { 0 };
 	 
-	silk_strv basename = { 0 };
-
 	const char* linked_output_dir;
 	silk_strv linked_project_name = { 0 };
 	silk_project_t* linked_project = NULL;
 	const char* tmp; /* Temp string */
-	const char* current_object = NULL;
+	const char* object = NULL;
 	silk_size i = 0;
 	const char* _ = "  ";        /* Space to separate command arguments */
 	silk_size tmp_index = 0;           /* to save temporary allocation index */
@@ -2879,22 +8332,32 @@ silk_toolchain_gcc_bake(silk_toolchain* tc, const char* project_name)
 		return NULL;
 	}
 
-	/* gcc command */
-	
+	silk_dstr_init(&cflags);
 	silk_dstr_init(&str);
-
 	silk_dstr_init(&str_obj);
-
-	silk_darrT_init(&objects);
+	silk_dstr_init(&changed_obj);
+	silk_dstr_init(&members);
+	silk_dstr_init(&strings);
+	silk_dstr_init(&sources);
+	silk_dstr_init(&changed_units);
+	silk_darrT_init(&cmd_offsets);
+	silk_darrT_init(&actions);
+	silk_file_cache_init(&files);
+	silk_dstr_init(&depfile_content);
+	silk_dstr_init(&depfile_deps);
+	silk_db_init(&db);
+	silk_plan_init(&plan);
 
 	/* Get and format output directory */
 	output_dir = silk_get_output_directory(project, tc);
 
-	/* Create output directory if it does not exist yet. */
-	silk_create_directories(output_dir, strlen(output_dir));
+	/* Create output directory if it does not exist yet. A dry run doesn't write anything. */
+	if (!silk_dry_run_enabled)
+	{
+		silk_create_directories(output_dir, strlen(output_dir));
+	}
 
-	/* Start command */
-	silk_dstr_append_str(&str, "cc ");
+	silk_db_open(&db, silk_db_path(output_dir, project_name));
 
 	/* Handle binary type */
 	is_exe = silk_property_equals(project, silk_BINARY_TYPE, silk_EXE);
@@ -2907,6 +8370,8 @@ silk_toolchain_gcc_bake(silk_toolchain* tc, const char* project_name)
 		silk_set_and_goto(artefact, NULL, exit);
 	}
 
+	content_hash = silk_property_equals(project, silk_REBUILD_MODE, silk_CONTENT_HASH);
+
 	ext = is_exe ? "" : ext; /* do not provide extension to executables on linux */
 	ext = is_static_library ? ".a" : ext;
 	ext = is_shared_library ? ".so" : ext;
@@ -2916,18 +8381,22 @@ silk_toolchain_gcc_bake(silk_toolchain* tc, const char* project_name)
 		range = silk_mmap_get_range_str(&project->mmap, silk_CXFLAGS);
 		while (silk_mmap_range_get_next(&range, &current))
 		{
-			silk_dstr_append_strv(&str, current.u.strv);
-			silk_dstr_append_str(&str, _);
+			silk_dstr_append_strv(&cflags, current.u.strv);
+			silk_dstr_append_str(&cflags, _);
 		}
 	}
 
+	/* Compiler flags are also given to the linker, some of them are needed in both (-m32, -fsanitize, etc.) */
+	silk_dstr_append_str(&str, "cc ");
+	silk_dstr_append_strv(&str, silk_strv_make(cflags.data, cflags.size));
+
 	/* Append include directories */
 	{
 		range = silk_mmap_get_range_str(&project->mmap, silk_INCLUDE_DIRECTORIES);
 		while (silk_mmap_range_get_next(&range, &current))
 		{
 			tmp_index = silk_tmp_save();
-			silk_dstr_append_f(&str, "-I \"%s\" ", silk_path_get_absolute_dir(current.u.strv.data));
+			silk_dstr_append_f(&cflags, "-I \"%s\" ", silk_path_get_absolute_dir(current.u.strv.data));
 			silk_tmp_restore(tmp_index);
 		}
 	}
@@ -2937,18 +8406,23 @@ silk_toolchain_gcc_bake(silk_toolchain* tc, const char* project_name)
 		range = silk_mmap_get_range_str(&project->mmap, silk_DEFINES);
 		while (silk_mmap_range_get_next(&range, &current))
 		{
-			silk_dstr_append_f(&str, "-D%.*s ", current.u.strv);
+			silk_dstr_append_f(&cflags, "-D%.*s ", (int)current.u.strv.size, current.u.strv.data);
 		}
 	}
 
 	if (is_static_library)
 	{
 		artefact = silk_tmp_sprintf("%slib%s%s", output_dir, project_name, ext);
-		silk_dstr_append_str(&str, "-c ");
+		if (!silk_file_mtime(artefact, &artefact_mtime))
+		{
+			artefact_mtime = 0;
+		}
 	}
 
 	if (is_shared_library)
 	{
+		/* Objects of a shared library are compiled separately so they need to be position independent. */
+		silk_dstr_append_str(&cflags, "-fPIC ");
 		silk_dstr_append_str(&str, "-shared ");
 		artefact = silk_tmp_sprintf("%slib%s%s", output_dir, project_name, ext);
 		silk_dstr_append_f(&str, "-o \"%s\" ", artefact);
@@ -2960,30 +8434,231 @@ silk_toolchain_gcc_bake(silk_toolchain* tc, const char* project_name)
 		silk_dstr_append_f(&str, "-o \"%s\" ", artefact);
 	}
 
-	/* Append .c files and .obj */
+	source_count = silk_gcc_compile_units(project, output_dir, &sources, &changed_units);
+	if (source_count == SILK_NPOS)
 	{
-		range = silk_mmap_get_range_str(&project->mmap, silk_FILES);
-		while (silk_mmap_range_get_next(&range, &current))
+		silk_set_and_goto(artefact, NULL, exit);
+	}
+
+	/* The precompiled header is included by all the compile commands */
+	if (try_get_property_strv(project, silk_PRECOMPILED_HEADER, &precompiled_header))
+	{
+		tmp_index = silk_tmp_save();
+		tmp = silk_gcc_precompile_header(tc, &files, silk_path_get_absolute_file(precompiled_header.data), cflags.data,
+			sources.data, source_count, &depfile_content, &depfile_deps, &pch_mtime, &pch_digest, silk_dry_run_enabled ? &plan : NULL);
+		if (tmp)
+		{
+			silk_dstr_append_str(&cflags, tmp);
+			silk_digest_to_hex(pch_digest, pch_key);
+		}
+		silk_tmp_restore(tmp_index);
+
+		if (!tmp)
+		{
+			silk_set_and_goto(artefact, NULL, exit);
+		}
+	}
+
+	if (silk_compile_commands_enabled() && !silk_dry_run_enabled)
+	{
+		silk_gcc_write_compile_commands(project, output_dir, cflags.data);
+	}
+
+	/* Kept in the temp buffer until the compile actions are done */
+	compile_flags.cflags = cflags.data;
+	compile_flags.args = silk_tmp_split_args(silk_tmp_sprintf("cc %s", cflags.data));
+	compile_flags.arg_count = 0;
+	while (compile_flags.args[compile_flags.arg_count] != NULL)
+	{
+		compile_flags.arg_count += 1;
+	}
+
+	/* One compile command per .c file */
+	{
+		for (source = sources.data; source_count > 0; source_count--, source += strlen(source) + 1)
 		{
-			/* Absolute file is created using the tmp buffer allocator but we don't need it once it's inserted into the dynamic string */
 			tmp_index = silk_tmp_save();
-			/* add .c files */
-			silk_dstr_append_f(&str, "\"%s\" ", silk_path_get_absolute_file(current.u.strv.data));
-			silk_tmp_restore(tmp_index);
-			
-			basename = silk_path_basename(current.u.strv);
 
-			if (is_exe || is_static_library)
+			/* output/dir/obj/my/file.o */
+			object = silk_gcc_object_path(output_dir, source);
+
+			/* Example: cc <flags> <includes> -MMD -MF "output/dir/obj/my/file.d" -c "my/file.c" -o "output/dir/obj/my/file.o" */
+			tmp = silk_tmp_sprintf("cc %s-MMD -MF \"%s\" -c \"%s\" -o \"%s\"", cflags.data, silk_gcc_depfile_path(object), source, object);
+
+			/* The digest of the headers of the precompiled header is hashed with the command */
+			reason = content_hash
+				? silk_gcc_object_digest_stale_reason(&files, &db, output_dir, silk_tmp_sprintf("%s%s", tmp, pch_key), object, &depfile_content, &depfile_deps, &object_mtime)
+				: silk_gcc_object_stale_reason(&files, &db, output_dir, source, object, "object", silk_gcc_depfile_path(object), &depfile_content, &depfile_deps, &object_mtime);
+
+			for (cursor = changed_units.data; !reason && cursor < changed_units.data + changed_units.size; cursor += strlen(cursor) + 1)
+			{
+				reason = strcmp(cursor, source) == 0 ? "unity file changed" : NULL;
+			}
+
+			if (!reason && !content_hash && object_mtime < pch_mtime)
+			{
+				reason = "precompiled header is newer than the object";
+			}
+
+			/* The digest of the content already covers the command */
+			if (!reason && !content_hash && !silk_command_fingerprint_matches(&db, object, tmp))
+			{
+				reason = "command changed";
+			}
+
+			if (reason)
+			{
+				silk_log_debug("Compiling '%s': %s.", source, reason);
+
+				/* Create the directories of the object */
+				if (!silk_dry_run_enabled)
+				{
+					silk_create_directories(object, strlen(object));
+				}
+
+				silk_darrT_push_back(&cmd_offsets, silk_dstr_push_str(&strings, tmp));
+				silk_darrT_push_back(&cmd_offsets, silk_dstr_push_str(&strings, source));
+				silk_darrT_push_back(&cmd_offsets, silk_dstr_push_str(&strings, object));
+				silk_darrT_push_back(&cmd_offsets, silk_dstr_push_str(&strings, reason));
+			}
+			else if (object_mtime > newest_input_mtime)
+			{
+				newest_input_mtime = object_mtime;
+			}
+
+			/* Objects compiled after the last archive, including the ones compiled now */
+			if (is_static_library && (reason || object_mtime > artefact_mtime))
 			{
-				/* output/dir/my_object.o */
-				silk_dstr_append_f(&str_obj, "\"%s%.*s.o\" ", output_dir, basename.size, basename.data);
+				silk_dstr_append_f(&changed_obj, "\"%s\" ", object);
+			}
+
+			silk_dstr_append_f(&str_obj, "\"%s\" ", object);
+
+			silk_tmp_restore(tmp_index);
+		}
+	}
+
+	/* Commands are only referenced once 'strings' won't grow anymore. */
+	for (i = 0; i < silk_darrT_size(&cmd_offsets); i += 4)
+	{
+		action.cmd = strings.data + silk_darrT_at(&cmd_offsets, i);
+		action.input = strings.data + silk_darrT_at(&cmd_offsets, i + 1);
+		action.output = strings.data + silk_darrT_at(&cmd_offsets, i + 2);
+		action.directory = output_dir;
+		/* Flags are part of the key of the objects in the cache */
+		action.run = silk_cache_dir ? silk_gcc_cached_compile : silk_gcc_compile;
+		action.user_data = &compile_flags;
+		silk_darrT_push_back(&actions, action);
+	}
+
+	/* The link waits for all the compilations, the longest ones are started first so they don't end alone */
+	/* The dry run prints how long they took */
+	if (silk_darrT_size(&actions) > 1 || silk_dry_run_enabled)
+	{
+		has_history = silk_actions_expect_durations(actions.darr.data, silk_darrT_size(&actions), &db);
+	}
+
+	if (silk_dry_run_enabled)
+	{
+		for (i = 0; i < silk_darrT_size(&actions); ++i)
+		{
+			action = silk_darrT_at(&actions, i);
+			silk_plan_add(&plan, "compile", action.input, strings.data + silk_darrT_at(&cmd_offsets, i * 4 + 3),
+				has_history ? action.expected_duration : -1);
+		}
+	}
+
+	compiled = silk_dry_run_enabled || silk_run_actions(actions.darr.data, silk_darrT_size(&actions));
+
+	/* Objects successfully compiled are recorded even if another one failed so they are not compiled again. */
+	for (i = 0; i < silk_darrT_size(&actions) && !silk_dry_run_enabled; ++i)
+	{
+		action = silk_darrT_at(&actions, i);
+		if (action.exit_code == 0)
+		{
+			silk_db_put_duration(&db, action.output, action.duration);
+
+			tmp_index = silk_tmp_save();
+			silk_gcc_record_object(&db, &files, output_dir, content_hash ? silk_tmp_sprintf("%s%s", action.cmd, pch_key) : action.cmd, action.output,
+				content_hash, &depfile_content, &depfile_deps);
+			silk_tmp_restore(tmp_index);
+		}
+	}
+
+	/* Committed before the link, an interrupted link does not compile them again */
+	if (!silk_dry_run_enabled)
+	{
+		silk_db_commit(&db);
+	}
+
+	if (!compiled)
+	{
+		silk_set_and_goto(artefact, NULL, exit);
+	}
+
+	if (is_static_library)
+	{
+		/* A thin archive only references the objects, they are not copied. */
+		thin = silk_property_equals(project, silk_THIN_ARCHIVE, silk_ON);
+
+		/* The list of members is kept in the database. When the same objects are archived again only
+		   the changed ones are replaced, otherwise the archive is created from scratch so objects of removed files are not kept. */
+		silk_dstr_assign_f(&members, "%s\n%s", thin ? "thin" : "normal", str_obj.data);
+
+		same_members = artefact_mtime > 0
+			&& silk_db_get(&db, silk_tmp_sprintf("members %s", artefact), &recorded_members)
+			&& silk_strv_equals(recorded_members, members.data, members.size);
+
+		if (same_members && changed_obj.size == 0)
+		{
+			goto exit; /* Nothing changed */
+		}
+
+		if (silk_dry_run_enabled)
+		{
+			reason = artefact_mtime == 0 ? "archive does not exist"
+				: (!same_members ? "members changed" : "objects are newer than the archive");
+			silk_plan_add(&plan, "archive", artefact, reason,
+				silk_db_get_duration(&db, artefact, &expected_duration) ? expected_duration : -1);
+			silk_plan_rebuild(artefact);
+			goto exit;
+		}
 
-				/* my_object.o */
-				silk_darrT_push_back(&objects, silk_tmp_sprintf("%.*s.o", basename.size, basename.data));
+		if (same_members && !silk_gcc_objects_share_a_name(str_obj.data))
+		{
+			/* Example: ar -rs libMyLib.a MyChangedObject.o */
+			tmp = silk_tmp_sprintf("ar -rs%s \"%s\" %s ", thin ? "T" : "", artefact, changed_obj.data);
+		}
+		else
+		{
+			silk_db_put(&db, silk_tmp_sprintf("members %s", artefact), "", 0);
+			if (silk_path_exists(artefact))
+			{
+				silk_delete_file(artefact);
 			}
+
+			/* Create libXXX.a in the output directory */
+			/* Example: ar -crs libMyLib.a MyObjectAo MyObjectB.o */
+			tmp = silk_tmp_sprintf("ar -crs%s \"%s\" %s ", thin ? "T" : "", artefact, str_obj.data);
+		}
+
+		silk_job_acquire();
+		start_time = silk_time_ms();
+		exit_code = silk_gcc_process(tmp, output_dir, silk_tmp_sprintf("%s.rsp", artefact));
+		silk_job_release();
+		silk_trace_add("archive", artefact, start_time, tmp, artefact, exit_code);
+		if (exit_code != 0)
+		{
+			silk_set_and_goto(artefact, NULL, exit);
 		}
+		silk_db_put(&db, silk_tmp_sprintf("members %s", artefact), members.data, members.size);
+		silk_db_put_duration(&db, artefact, silk_time_ms() - start_time);
+		goto exit; /* Nothing to link */
 	}
 
+	/* Link objects */
+	silk_dstr_append_strv(&str, silk_strv_make(str_obj.data, str_obj.size));
+
 	/* Append libraries */
 	{
 		range = silk_mmap_get_range_str(&project->mmap, silk_LIBRARIES);
@@ -2993,20 +8668,26 @@ silk_toolchain_gcc_bake(silk_toolchain* tc, const char* project_name)
 		}
 	}
 
-	/* For each linked project we add the link information to the gcc command */
-	range = silk_mmap_get_range_str(&project->mmap, silk_LINK_PROJECTS);
-	if (range.count > 0)
+	/* Add linker flags */
 	{
-		/* Add linker flags */
+		lflag_range = silk_mmap_get_range_str(&project->mmap, silk_LFLAGS);
+		while (silk_mmap_range_get_next(&lflag_range, &current_lflag))
 		{
-			lflag_range = silk_mmap_get_range_str(&project->mmap, silk_LFLAGS);
-			while (silk_mmap_range_get_next(&lflag_range, &current_lflag))
-			{
-				silk_dstr_append_strv(&str, current_lflag.u.strv);
-				silk_dstr_append_str(&str, _);
-			}
+			silk_dstr_append_strv(&str, current_lflag.u.strv);
+			silk_dstr_append_str(&str, _);
 		}
+	}
+
+	/* Use another linker than the default one */
+	if (try_get_property_strv(project, silk_LINKER, &linker))
+	{
+		silk_dstr_append_str(&str, silk_gcc_linker_flags(linker.data, &linker_threads));
+	}
 
+	/* For each linked project we add the link information to the gcc command */
+	range = silk_mmap_get_range_str(&project->mmap, silk_LINK_PROJECTS);
+	if (range.count > 0)
+	{
 		/* Give some parameters to the linker to  look for the shared library next to the binary being built */
 		silk_dstr_append_str(&str, " -Wl,-rpath,$ORIGIN ");
 
@@ -3015,7 +8696,7 @@ silk_toolchain_gcc_bake(silk_toolchain* tc, const char* project_name)
 			linked_project_name = current.u.strv;
 
 			linked_project = silk_find_project_by_name(linked_project_name);
-			if (!project)
+			if (!linked_project)
 			{
 				silk_set_and_goto(artefact, NULL, exit);
 			}
@@ -3030,13 +8711,34 @@ silk_toolchain_gcc_bake(silk_toolchain* tc, const char* project_name)
 				silk_dstr_append_f(&str, "-L \"%s\" -l \"%.*s\" ", linked_output_dir, linked_project_name.size, linked_project_name.data);
 			}
 
+			/* Is static library */
+			if (silk_property_equals(linked_project, silk_BINARY_TYPE, silk_STATIC_LIBRARY))
+			{
+				/* libmy_project.a */
+				tmp = silk_tmp_sprintf("%slib%.*s.a", linked_output_dir, linked_project_name.size, linked_project_name.data);
+
+				/* Relink when the library changed */
+				if (silk_file_mtime(tmp, &object_mtime) && object_mtime > newest_input_mtime)
+				{
+					newest_input_mtime = object_mtime;
+				}
+				linked_rebuilt = linked_rebuilt || (silk_dry_run_enabled && silk_plan_is_rebuilt(tmp));
+			}
+
 			/* Is shared library */
 			if (silk_property_equals(linked_project, silk_BINARY_TYPE, silk_SHARED_LIBRARY))
 			{
 				/* libmy_project.so*/
 				tmp = silk_tmp_sprintf("%slib%.*s.so", linked_output_dir, linked_project_name.size, linked_project_name.data);
 
-				if (!silk_copy_file_to_dir(tmp, output_dir))
+				if (silk_file_mtime(tmp, &object_mtime) && object_mtime > newest_input_mtime)
+				{
+					newest_input_mtime = object_mtime;
+				}
+
+				linked_rebuilt = linked_rebuilt || (silk_dry_run_enabled && silk_plan_is_rebuilt(tmp));
+
+				if (!silk_dry_run_enabled && !silk_copy_file_to_dir_if_newer(tmp, output_dir))
 				{
 					silk_set_and_goto(artefact, NULL, exit);
 				}
@@ -3044,29 +8746,63 @@ silk_toolchain_gcc_bake(silk_toolchain* tc, const char* project_name)
 		}
 	}
 
-	/* Example: gcc <includes> -c  <c source files> */
-	if (silk_process_in_directory(str.data, output_dir) != 0)
+	/* Linked again when the command changed (flags, libraries, etc.) */
+	if (silk_darrT_size(&actions) == 0 && !linked_rebuilt && silk_gcc_artefact_is_up_to_date(artefact, newest_input_mtime)
+		&& silk_command_fingerprint_matches(&db, artefact, str.data))
 	{
-		silk_set_and_goto(artefact, NULL, exit);
+		goto exit; /* Nothing changed */
 	}
 
-	if (is_static_library || is_shared_library)
+	if (silk_dry_run_enabled)
 	{
-		if (is_static_library)
-		{
-			/* Create libXXX.a in the output directory */
-			/* Example: ar -crs libMyLib.a MyObjectAo MyObjectB.o */
-			tmp = silk_tmp_sprintf("ar -crs \"%s\" %s ", artefact, str_obj.data);
-			if (silk_process_in_directory(tmp, output_dir) != 0)
-			{
-				silk_set_and_goto(artefact, NULL, exit);
-			}
-		}
+		reason = silk_darrT_size(&actions) > 0 ? "objects are compiled"
+			: (linked_rebuilt ? "a linked library is rebuilt"
+			: (!silk_path_exists(artefact) ? "artefact does not exist"
+			: (!silk_gcc_artefact_is_up_to_date(artefact, newest_input_mtime) ? "an input is newer than the artefact" : "command changed")));
+		silk_plan_add(&plan, "link", artefact, reason,
+			silk_db_get_duration(&db, artefact, &expected_duration) ? expected_duration : -1);
+		silk_plan_rebuild(artefact);
+		goto exit;
+	}
+
+	/* Example: cc -o <artefact> <objects> <libraries> */
+	silk_job_acquire();
+	start_time = silk_time_ms();
+	tmp = silk_tmp_sprintf("%s%s", str.data, linker_threads);
+	exit_code = silk_gcc_process(tmp, output_dir, silk_tmp_sprintf("%s.rsp", artefact));
+	silk_job_release();
+	silk_trace_add("link", artefact, start_time, tmp, artefact, exit_code);
+	if (exit_code != 0)
+	{
+		silk_set_and_goto(artefact, NULL, exit);
 	}
+	silk_record_command_fingerprint(&db, artefact, str.data);
+	silk_db_put_duration(&db, artefact, silk_time_ms() - start_time);
 
 exit:
+	if (silk_dry_run_enabled)
+	{
+		silk_plan_report(&plan, project_name);
+	}
+	else
+	{
+		silk_db_commit(&db);
+	}
+	silk_plan_destroy(&plan);
+	silk_dstr_destroy(&cflags);
 	silk_dstr_destroy(&str);
 	silk_dstr_destroy(&str_obj);
+	silk_dstr_destroy(&changed_obj);
+	silk_dstr_destroy(&members);
+	silk_dstr_destroy(&strings);
+	silk_dstr_destroy(&sources);
+	silk_dstr_destroy(&changed_units);
+	silk_darrT_destroy(&cmd_offsets);
+	silk_darrT_destroy(&actions);
+	silk_file_cache_destroy(&files);
+	silk_dstr_destroy(&depfile_content);
+	silk_dstr_destroy(&depfile_deps);
+	silk_db_destroy(&db);
 
 	return artefact;
 }